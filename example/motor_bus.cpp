@@ -0,0 +1,48 @@
+
+#include <csignal>
+#include <cstdio>
+#include <unistd.h>
+
+#include "../sdk/deep_motor_sdk.hpp"
+
+#define MOTOR_NUMBER 2
+
+volatile sig_atomic_t break_flag = 0;
+void sigint_handler(int sig) {
+    break_flag = 1;
+}
+
+int main(){
+    signal(SIGINT, sigint_handler);
+    printf("[INFO] Started motor bus control\r\n");
+
+    //创建基于socketcan的can0总线对象，关节数量在编译期确定
+    //Create a socketcan-based can0 bus object, the motor count is fixed at compile time
+    deep_motor::MotorBus<MOTOR_NUMBER> bus("can0", {1, 2}, false);
+
+    //使能总线上的所有关节
+    //Enable all motors on the bus
+    bus.SendAll<ENABLE_MOTOR>();
+
+    //发送控制命令
+    //Send control cmd
+    while(!break_flag)
+    {
+        for(std::size_t i = 0; i < bus.size(); i++){
+            bus.SetMotion(i, 0, 0, 0.5, 0, 0);
+        }
+        const auto &ret = bus.ControlBurst();
+        for(std::size_t i = 0; i < bus.size(); i++){
+            CheckSendRecvError(bus.motor_id(i), ret[i]);
+        }
+        usleep(1000);
+    }
+    printf("[INFO] main thread loop stoped\r\n");
+
+    //失能总线上的所有关节，bus析构时释放socket
+    //Disable all motors on the bus, the socket is released when bus is destroyed
+    bus.SendAll<DISABLE_MOTOR>();
+
+    printf("[INFO] Ended motor bus control\r\n");
+    return 0;
+}
@@ -1,10 +1,19 @@
 
 #include "example.h"
+#include "../sdk/motor_estop.h"
 
 #define MOTOR_NUMBER 2
 
+MotorEStop *estop = NULL;
+
+//ctrl+c时立即失能所有关节，再通知各线程退出
+//On ctrl+c disable all motors at once, then tell the threads to stop
+void estop_sigint_handler(int sig) {
+    MotorEStopTrigger(estop, kEStopSignal);
+    break_flag = 1;
+}
+
 int main(){
-    signal(SIGINT, sigint_handler);
     printf("[INFO] Started multi motor control\r\n");
 
     //创建基于socketcan的can0设备对象
@@ -13,6 +22,27 @@ int main(){
     MotorCMD *motor_cmd = MotorCMDCreate();
     MotorDATA *motor_data = MotorDATACreate();
 
+    //创建急停对象，预先生成同一总线上所有关节的失能帧
+    //Create the e-stop object, pre-building disable frames of all motors on the can bus
+    uint8_t motor_ids[MOTOR_NUMBER];
+    for(int i = 0; i < MOTOR_NUMBER; i++){
+        motor_ids[i] = i+1;
+    }
+    //急停不可用时退回到退出时逐个失能关节
+    //Without the e-stop, fall back to disabling the motors one by one at shutdown
+    estop = MotorEStopCreate(kEStopDisable);
+    if(estop == NULL || MotorEStopAddBus(estop, "can0", motor_ids, MOTOR_NUMBER) != 0 || MotorEStopStart(estop) != 0){
+        printf("[WARN] E-stop unavailable, motors are disabled one by one at shutdown\r\n");
+        if(estop != NULL){
+            MotorEStopDestroy(estop);
+            estop = NULL;
+        }
+        signal(SIGINT, sigint_handler);
+    }
+    else{
+        signal(SIGINT, estop_sigint_handler);
+    }
+
     //使能同一总线上的关节
     //Enable all motors on the same can bus
     for(int i = 0; i < MOTOR_NUMBER; i++){
@@ -56,16 +86,31 @@ int main(){
         }
     }
 
-    //失能同一总线上的所有关节
-    //Disable all motors on the can bus
-    for(int i = 0; i < MOTOR_NUMBER; i++){
-        int motor_id = i+1;
-        SetNormalCMD(motor_cmd, motor_id, DISABLE_MOTOR);
-        SendRecv(can, motor_cmd, motor_data);
+    //失能同一总线上的所有关节，并等待所有关节应答
+    //Disable all motors on the can bus and wait for every motor to reply
+    bool disabled = false;
+    if(estop != NULL){
+        MotorEStopTrigger(estop, kEStopManual);
+        disabled = MotorEStopWaitConfirmed(estop, 100);
+        if(!disabled){
+            printf("[WARN] Not all motors confirmed disable, disabling one by one\r\n");
+        }
+        PrintMotorEStopLatency(estop);
+    }
+    if(!disabled){
+        for(int i = 0; i < MOTOR_NUMBER; i++){
+            int motor_id = i+1;
+            SetNormalCMD(motor_cmd, motor_id, DISABLE_MOTOR);
+            SendRecv(can, motor_cmd, motor_data);
+        }
     }
 
     //回收资源
     //Reclaim allocated memory
+    signal(SIGINT, sigint_handler);
+    if(estop != NULL){
+        MotorEStopDestroy(estop);
+    }
     DrMotorCanDestroy(can);
     MotorCMDDestroy(motor_cmd);
     MotorDATADestroy(motor_data);
@@ -0,0 +1,141 @@
+//不连接can总线，用模拟的关节应答运行轨迹流、遥测和整机快照
+//Run trajectory streaming, telemetry and whole-body snapshots against emulated motor replies, without a can bus
+#include <math.h>
+
+#include "../sdk/motor_trajectory.h"
+#include "../sdk/motor_telemetry.h"
+#include "../sdk/motor_snapshot.h"
+
+#define MOTOR_NUMBER 3
+#define CONTROL_RATE 1000
+#define WAYPOINT_RATE 100
+#define DURATION 20.0
+
+//第3个关节在该时间之后不再应答
+//The 3rd motor stops replying after this time
+#define SILENT_TIME 10.0
+
+typedef struct{
+    float position;
+    float motor_temp;
+    float driver_temp;
+    bool flag;
+}FakeMotor;
+
+//模拟的关节: 位置一阶跟踪命令，关节温度按heating(°C/s)上升，按CONTROL_MOTOR应答格式组帧
+//Emulated motor: position follows the cmd with a first-order lag, motor temperature rises at heating C/s,
+//the reply is framed in the CONTROL_MOTOR reply format
+void FakeMotorReply(FakeMotor *motor, const MotorCMD *cmd, float heating, float dt, struct can_frame *frame){
+    motor->position += (cmd->position_ - motor->position) * 0.5f;
+    motor->motor_temp += heating * dt;
+    motor->flag = !motor->flag;
+
+    ReceivedMotionData reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.position = FloatToUint(motor->position, POSITION_MIN, POSITION_MAX, RECEIVE_POSITION_LENGTH);
+    reply.velocity = FloatToUint(cmd->velocity_, VELOCITY_MIN, VELOCITY_MAX, RECEIVE_VELOCITY_LENGTH);
+    reply.torque = FloatToUint(0, TORQUE_MIN, TORQUE_MAX, RECEIVE_TORQUE_LENGTH);
+    reply.temp_flag = motor->flag;
+    if(motor->flag == kMotorTempFlag){
+        reply.temperature = FloatToUint(motor->motor_temp, MOTOR_TEMP_MIN, MOTOR_TEMP_MAX, RECEIVE_TEMP_LENGTH);
+    }
+    else{
+        reply.temperature = FloatToUint(motor->driver_temp, DRIVER_TEMP_MIN, DRIVER_TEMP_MAX, RECEIVE_TEMP_LENGTH);
+    }
+    frame->can_id = FormCanId(CONTROL_MOTOR, cmd->motor_id_);
+    frame->can_dlc = RECEIVE_DLC_CONTROL_MOTOR;
+    memcpy(frame->data, reply.data, sizeof(reply.data));
+}
+
+double alarm_time = 0;
+double sim_time = 0;
+void OnTempAlarm(uint8_t motor_id, int alarm, float value, void *user){
+    if(alarm_time == 0){
+        alarm_time = sim_time;
+    }
+    printf("[WARN] Motor with id: %d temperature alarm at %.2f s, predicted %.1f\r\n", (uint32_t)motor_id, sim_time, value);
+}
+
+int main(){
+    printf("[INFO] Started offline motion\r\n");
+
+    //模拟时钟的终点为当前时间，使快照按MotorClockNow()计算的采样时长有意义
+    //The emulated clock ends at the current time, so the sample age of snapshots against MotorClockNow() is meaningful
+    double start = MotorClockNow() - DURATION;
+
+    float initial_position[MOTOR_NUMBER] = {0, 0, 0};
+    TrajectoryStream *stream = TrajectoryStreamCreate(MOTOR_NUMBER, kTrajectoryCubic, initial_position, start);
+    if(stream == NULL){
+        return -1;
+    }
+    MotorTelemetry telemetry[MOTOR_NUMBER];
+    FakeMotor motors[MOTOR_NUMBER];
+    MotorCMD motor_cmds[MOTOR_NUMBER];
+    MotorDATA motor_datas[MOTOR_NUMBER] = {0};
+    for(int i = 0; i < MOTOR_NUMBER; i++){
+        MotorTelemetryInit(&telemetry[i], i+1, 0.05f);
+        MotorTelemetrySetAlarm(&telemetry[i], 80.0f, 80.0f, 3.0f, 5.0f, OnTempAlarm, NULL);
+        motors[i].position = 0;
+        motors[i].motor_temp = 40.0f;
+        motors[i].driver_temp = 35.0f;
+        motors[i].flag = false;
+    }
+
+    //规划器只发送位置，路点速度由轨迹流估计
+    //The planner sends positions only, waypoint velocities are estimated by the stream
+    int waypoint = 1;
+    float max_velocity_error = 0;
+    int cycles = (int)(DURATION * CONTROL_RATE);
+    for(int cycle = 0; cycle < cycles; cycle++){
+        sim_time = (double)cycle / CONTROL_RATE;
+        double now = start + sim_time;
+        while((double)waypoint / WAYPOINT_RATE < sim_time + 0.05){
+            double t = (double)waypoint / WAYPOINT_RATE;
+            for(int i = 0; i < MOTOR_NUMBER; i++){
+                TrajectoryPoint point = {start + t, (float)sin(2.0 * t + i), 0, 0, 0};
+                TrajectoryPush(stream, i, &point);
+            }
+            waypoint++;
+        }
+
+        TrajectoryEvaluate(stream, now);
+        for(int i = 0; i < MOTOR_NUMBER; i++){
+            TrajectorySetMotionCMD(stream, i, &motor_cmds[i], i+1, 0, 30, 1);
+            if(sim_time > 0.1){
+                float error = fabsf(stream->velocity_[i] - (float)(2.0 * cos(2.0 * sim_time + i)));
+                max_velocity_error = error > max_velocity_error ? error : max_velocity_error;
+            }
+            if(i == 2 && sim_time > SILENT_TIME){
+                continue;
+            }
+            //第1个关节从5 s开始以3 °C/s升温
+            //The 1st motor heats up at 3 C/s from 5 s on
+            float heating = (i == 0 && sim_time > 5.0) ? 3.0f : 0;
+            struct can_frame frame;
+            FakeMotorReply(&motors[i], &motor_cmds[i], heating, 1.0f / CONTROL_RATE, &frame);
+            ParseRecvFrame(&frame, &motor_datas[i]);
+            motor_datas[i].stamp_ = now;
+            MotorTelemetryUpdate(&telemetry[i], &motor_datas[i], now);
+        }
+    }
+
+    printf("[INFO] Trajectory max feed-forward velocity error: %f, underruns: %u\r\n",
+        max_velocity_error, stream->underrun_[0]);
+    if(alarm_time > 0){
+        printf("[INFO] Temperature alarm %.2f s before reaching 80 C\r\n", (80.0 - 40.0) / 3.0 + 5.0 - alarm_time);
+    }
+    for(int i = 0; i < MOTOR_NUMBER; i++){
+        printf("[INFO] Motor with id: %d motor temp ewma: %.1f, rate: %.2f C/s, torque rms: %.3f\r\n",
+            i+1, telemetry[i].motor_temp_.ewma_, telemetry[i].motor_temp_.rate_, telemetry[i].torque_rms_);
+    }
+
+    MotorDATA snapshot[MOTOR_NUMBER];
+    MotorSnapshotInfo info;
+    MotorSnapshotTake(motor_datas, MOTOR_NUMBER, 0, 0.01, true, snapshot, &info);
+    printf("[INFO] Snapshot skew: %f s, stale: %d, stale mask: 0x%llx\r\n",
+        info.skew_, info.stale_num_, (unsigned long long)info.stale_mask_);
+
+    TrajectoryStreamDestroy(stream);
+    printf("[INFO] Ended offline motion\r\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+
+//在虚拟can总线上运行收发循环，并打印各阶段的耗时分布
+//Run the send/receive loop on a virtual can bus and print the time distribution of every phase
+#ifndef DEEP_MOTOR_TRACE
+#define DEEP_MOTOR_TRACE
+#endif
+
+#include "example.h"
+
+#define MOTOR_NUMBER 12
+#define CYCLE_NUMBER 10000
+
+typedef struct{
+    const char *can_name;
+    int motor_number;
+}FakeMotorThreadParam;
+
+//模拟总线上的关节，对每个CONTROL_MOTOR帧回复一帧应答
+//Emulate the motors on the bus, replying one frame to every CONTROL_MOTOR frame
+void *FakeMotorThreadFunc(void *args){
+    FakeMotorThreadParam *params = (FakeMotorThreadParam *)args;
+    DrMotorCan *can = DrMotorCanCreate(params->can_name, false);
+    struct can_frame frame;
+    while(!break_flag){
+        struct epoll_event events;
+        if(epoll_wait(can->epoll_fd_, &events, 1, 10) <= 0){
+            continue;
+        }
+        while(read(can->can_socket_, &frame, sizeof(frame)) == sizeof(frame)){
+            uint32_t cmd = (frame.can_id >> CAN_ID_SHIFT_BITS) & 0x3f;
+            uint32_t motor_id = frame.can_id & 0x0f;
+            if(cmd != CONTROL_MOTOR || motor_id == 0 || motor_id > (uint32_t)params->motor_number){
+                continue;
+            }
+            frame.can_dlc = RECEIVE_DLC_CONTROL_MOTOR;
+            frame.data[7] = (uint8_t)((60 << 1) | (motor_id & 0x01));
+            if(write(can->can_socket_, &frame, sizeof(frame)) != sizeof(frame)){
+                printf("[WARN] Fake motor with id: %d reply failed\r\n", motor_id);
+            }
+        }
+    }
+    DrMotorCanDestroy(can);
+    return NULL;
+}
+
+int main(int argc, char **argv){
+    const char *can_name = argc > 1 ? argv[1] : "vcan0";
+    signal(SIGINT, sigint_handler);
+    printf("[INFO] Started trace report on %s\r\n", can_name);
+
+    FakeMotorThreadParam param;
+    param.can_name = can_name;
+    param.motor_number = MOTOR_NUMBER;
+    pthread_t fake_thread;
+    if(pthread_create(&fake_thread, NULL, FakeMotorThreadFunc, (void*)&param) != 0){
+        fprintf(stderr, "Failed to create thread.\n");
+        return 1;
+    }
+    usleep(100000);
+
+    DrMotorCan *can = DrMotorCanCreate(can_name, false);
+    MotorCMD motor_cmds[MOTOR_NUMBER];
+    MotorDATA motor_datas[MOTOR_NUMBER];
+    int rets[MOTOR_NUMBER];
+    for(int i = 0; i < MOTOR_NUMBER; i++){
+        SetMotionCMD(&motor_cmds[i], i+1, CONTROL_MOTOR, 0, 0, 0.5, 0, 0);
+    }
+
+    //逐个关节收发
+    //Send and receive motor by motor
+    for(int cycle = 0; cycle < CYCLE_NUMBER && !break_flag; cycle++){
+        for(int i = 0; i < MOTOR_NUMBER; i++){
+            SendRecv(can, &motor_cmds[i], &motor_datas[i]);
+        }
+    }
+    MotorTrace trace;
+    DrMotorCanGetTrace(can, &trace);
+    printf("[INFO] SendRecv(), %d motors, %d cycles\r\n", MOTOR_NUMBER, CYCLE_NUMBER);
+    PrintMotorTrace(&trace);
+
+    //突发收发
+    //Send and receive as one burst
+    DrMotorCanResetTrace(can);
+    for(int cycle = 0; cycle < CYCLE_NUMBER && !break_flag; cycle++){
+        SendRecvBurst(can, motor_cmds, motor_datas, rets, MOTOR_NUMBER);
+    }
+    DrMotorCanGetTrace(can, &trace);
+    printf("[INFO] SendRecvBurst(), %d motors, %d cycles\r\n", MOTOR_NUMBER, CYCLE_NUMBER);
+    PrintMotorTrace(&trace);
+
+    CanBusHealth health;
+    DrMotorCanGetHealth(can, &health);
+    CheckCanBusHealth(can_name, &health);
+
+    break_flag = 1;
+    pthread_join(fake_thread, NULL);
+    DrMotorCanDestroy(can);
+    printf("[INFO] Ended trace report\r\n");
+    return 0;
+}
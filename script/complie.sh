@@ -3,7 +3,12 @@ echo "current folder: $SCRIPT_DIR"
 
 cd $SCRIPT_DIR/../example
 
-gcc -o single_motor single_motor.c -g -lpthread
+gcc -o single_motor single_motor.c -g -lpthread -lm
 
-gcc -o multi_motor multi_motor.c -g -lpthread
+gcc -o multi_motor multi_motor.c -g -lpthread -lm
 
+g++ -o motor_bus motor_bus.cpp -std=c++17 -O2 -g -lpthread -lm
+
+gcc -o trace_report trace_report.c -g -O2 -lpthread -lm
+
+gcc -o offline_motion offline_motion.c -g -O2 -lpthread -lm
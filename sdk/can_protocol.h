@@ -179,13 +179,13 @@ enum Temp_Flag{
     kMotorTempFlag=1
 };
 
-uint32_t FloatToUint(const float x, const float x_min, const float x_max, const uint8_t bits){
+static inline uint32_t FloatToUint(const float x, const float x_min, const float x_max, const uint8_t bits){
     /// Converts a float to an unsigned int, given range and number of bits ///
     float span = x_max - x_min;
     float offset = x_min;
     return (uint32_t)((x-offset)*((float)((1<<bits)-1))/span);
 }
-float UintToFloat(const int x_int, const float x_min, const float x_max, const uint8_t bits){
+static inline float UintToFloat(const int x_int, const float x_min, const float x_max, const uint8_t bits){
     /// converts unsigned int to float, given range and number of bits ///
     float span = x_max - x_min;
     float offset = x_min;
@@ -1,17 +1,25 @@
+#pragma once
 
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <sys/epoll.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <linux/can/raw.h>
+#include <linux/can/error.h>
+#include <linux/sockios.h>
+#include <errno.h>
 #include <sys/time.h>
+#include <time.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "can_protocol.h"
+#include "motor_trace.h"
 
 enum SendRecvRet{
     //*******************************
@@ -22,6 +30,8 @@ enum SendRecvRet{
     //接收超时错误返回-2
     //接收epoll错误返回-3
     //接收长度错误返回-4
+    //发送队列满或总线拥塞、命令被丢弃返回-5
+    //一次突发超过MAX_BURST_FRAMES帧、多出的帧未发送返回-6
 
     //*******************************
     //SendRecvRet: return value of SendRecv function
@@ -31,16 +41,44 @@ enum SendRecvRet{
     //return -2 receive timeout error
     //return -3 receive epoll error
     //return -4 receive length error
+    //return -5 send queue full or bus congested, cmd dropped
+    //return -6 burst larger than MAX_BURST_FRAMES, the extra frames are not sent
     kNoSendRecvError = 0,
     kSendLengthError = -1,
     kRecvTimeoutError = -2,
     kRecvEpollError = -3,
-    kRecvLengthError = -4
+    kRecvLengthError = -4,
+    kSendBusyError = -5,
+    kBurstSizeError = -6
 };
 
+//SendRecvFrames()一次最多收发的帧数，与电机id的4位宽度一致
+//Max number of frames per SendRecvFrames() call, matching the 4-bit motor id
+#define MAX_BURST_FRAMES 16
+
+//等待应答的超时时间，单位ms
+//Timeout waiting for replies, in ms
+#define RECV_TIMEOUT_MS 3
+
+//发送队列满时默认的最长等待时间，单位us
+//Default max wait when the send queue is full, in us
+#define SEND_BUDGET_US 1000
+
+//发送队列满时重试写入的间隔，单位us
+//Interval between write retries when the send queue is full, in us
+#define SEND_RETRY_INTERVAL_US 50
+
+//最后一次发送队列满之后，经过该时间或队列占用下降时解除拥塞标记，单位ms
+//The congestion mark is cleared this long after the last full send queue, or once the queue drains, in ms
+#define TX_CONGESTION_TIMEOUT_MS 10
+
+//超过该时间未收到错误帧时，错误警告/被动状态恢复为正常，单位ms
+//Error warning/passive state returns to active once no error frame arrived for this long, in ms
+#define CAN_STATE_EXPIRE_MS 1000
+
 //检查SendRecv函数返回值
 //Check the return value of SendRecv function
-void CheckSendRecvError(uint8_t motor_id, int code){
+static inline void CheckSendRecvError(uint8_t motor_id, int code){
     switch (code)
     {
     case kNoSendRecvError:
@@ -56,7 +94,13 @@ void CheckSendRecvError(uint8_t motor_id, int code){
         break;
     case kRecvLengthError:
         printf("[ERROR] Motor with id %d kRecvLengthError\r\n", (uint32_t)motor_id);
-        break;        
+        break;
+    case kSendBusyError:
+        printf("[WARN] Motor with id %d kSendBusyError\r\n", (uint32_t)motor_id);
+        break;
+    case kBurstSizeError:
+        printf("[ERROR] Motor with id %d kBurstSizeError\r\n", (uint32_t)motor_id);
+        break;
     default:
         break;
     }
@@ -95,7 +139,7 @@ enum MotorErrorType{
 
 //检查关节状态返回值
 //Check motor state
-void CheckMotorError(uint8_t motor_id, uint16_t code){
+static inline void CheckMotorError(uint8_t motor_id, uint16_t code){
     if(code != kMotorNoError){
         if(code & kOverVoltage){
             printf("[ERROR] Motor with id: %d kOverVoltage\r\n", (uint32_t)motor_id);
@@ -118,8 +162,27 @@ void CheckMotorError(uint8_t motor_id, uint16_t code){
     }
 }
 
-//存储电机返回的数据
-//Struct saving data from motor
+//单调时钟的当前时间，单位秒，MotorDATA的stamp_使用同一时钟
+//Current time of the monotonic clock in seconds, the same clock as stamp_ in MotorDATA
+static inline double MotorClockNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//将内核的接收时间戳(CLOCK_REALTIME)换算为MotorClockNow()的时间，按时间戳距今的时长计算，不受系统时间跳变影响
+//Convert a kernel receive timestamp (CLOCK_REALTIME) into MotorClockNow() time, computed from the age of the stamp
+//so a step of the system time does not affect it
+static inline double MotorClockFromRealtime(const struct timespec *stamp){
+    struct timespec real, mono;
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    int64_t age_ns = (int64_t)(real.tv_sec - stamp->tv_sec) * 1000000000LL + (real.tv_nsec - stamp->tv_nsec);
+    return (double)mono.tv_sec + (double)mono.tv_nsec * 1e-9 - (double)age_ns * 1e-9;
+}
+
+//存储电机返回的数据，stamp_为最近一次CONTROL_MOTOR应答(携带位置、速度、力矩)的内核接收时间
+//Struct saving data from motor, stamp_ is the kernel receive time of the latest CONTROL_MOTOR reply (carrying position, velocity and torque)
 typedef struct
 {
     uint8_t motor_id_;
@@ -129,20 +192,26 @@ typedef struct
     float torque_;
     bool flag_;
     float temp_;
+    float motor_temp_;
+    float driver_temp_;
     uint16_t error_;
+    double stamp_;
 }MotorDATA;
 
 //创建MotorDATA实例
 //Create MotorDATA object
-MotorDATA *MotorDATACreate(){
+static inline MotorDATA *MotorDATACreate(){
     MotorDATA *motor_data = (MotorDATA*)malloc(sizeof(MotorDATA));
+    motor_data->motor_temp_ = 0;
+    motor_data->driver_temp_ = 0;
     motor_data->error_ = kMotorNoError;
+    motor_data->stamp_ = 0;
     return motor_data;
 }
 
 //销毁MotorDATA实例
 //Destroy MotorData object
-void MotorDATADestroy(MotorDATA *motor_data){
+static inline void MotorDATADestroy(MotorDATA *motor_data){
     free(motor_data);
 }
 
@@ -161,21 +230,21 @@ typedef struct
 
 //创建MotorCMD实例
 //Create MotorCMD object
-MotorCMD *MotorCMDCreate(){
+static inline MotorCMD *MotorCMDCreate(){
     MotorCMD *motor_cmd = (MotorCMD*)malloc(sizeof(MotorCMD));
     return motor_cmd;
 }
 
 //往MotorCMD写入普通命令
 //Write normal cmd into MotorCMD
-void SetNormalCMD(MotorCMD *motor_cmd, uint8_t motor_id, uint8_t cmd){
+static inline void SetNormalCMD(MotorCMD *motor_cmd, uint8_t motor_id, uint8_t cmd){
     motor_cmd->motor_id_ = motor_id;
     motor_cmd->cmd_ = cmd;
 }
 
 //往MotorCMD写入控制命令
 //Write control cmd into MotorCMD
-void SetMotionCMD(MotorCMD *motor_cmd, uint8_t motor_id, uint8_t cmd, float position, float velocity, float torque, float kp, float kd){
+static inline void SetMotionCMD(MotorCMD *motor_cmd, uint8_t motor_id, uint8_t cmd, float position, float velocity, float torque, float kp, float kd){
     motor_cmd->motor_id_ = motor_id;
     motor_cmd->cmd_ = cmd;
     motor_cmd->position_ = position;
@@ -187,13 +256,13 @@ void SetMotionCMD(MotorCMD *motor_cmd, uint8_t motor_id, uint8_t cmd, float posi
 
 //销毁MotorCMD实例
 //Destroy MotorCMD object
-void MotorCMDDestroy(MotorCMD *motor_cmd){
+static inline void MotorCMDDestroy(MotorCMD *motor_cmd){
     free(motor_cmd);
 }
 
 //将MotorCMD中的float数据转换为CAN协议中发送的uint数据
 //Transform the float data in MotorCMD into uint data in can protocol
-void FloatsToUints(const MotorCMD *param, uint8_t *data)
+static inline void FloatsToUints(const MotorCMD *param, uint8_t *data)
 {
     uint16_t _position = FloatToUint(param->position_, POSITION_MIN, POSITION_MAX, SEND_POSITION_LENGTH);
     uint16_t _velocity = FloatToUint(param->velocity_, VELOCITY_MIN, VELOCITY_MAX, SEND_VELOCITY_LENGTH);
@@ -212,7 +281,7 @@ void FloatsToUints(const MotorCMD *param, uint8_t *data)
 
 //将CAN协议中收到的uint数据转换为MotorDATA中的float数据
 //Transform the uint data in can protocol into float data in MotorDATA
-void UintsToFloats(const struct can_frame *frame, MotorDATA *data)
+static inline void UintsToFloats(const struct can_frame *frame, MotorDATA *data)
 {
     const ReceivedMotionData *pcan_data = (const ReceivedMotionData*)frame->data;
     data->position_ = UintToFloat(pcan_data->position, POSITION_MIN, POSITION_MAX, RECEIVE_POSITION_LENGTH);
@@ -221,21 +290,23 @@ void UintsToFloats(const struct can_frame *frame, MotorDATA *data)
     data->flag_ = (bool)pcan_data->temp_flag;
     if(data->flag_ == kMotorTempFlag){
         data->temp_ = UintToFloat(pcan_data->temperature, MOTOR_TEMP_MIN, MOTOR_TEMP_MAX, RECEIVE_TEMP_LENGTH);
+        data->motor_temp_ = data->temp_;
     }
     else{
         data->temp_ = UintToFloat(pcan_data->temperature, DRIVER_TEMP_MIN, DRIVER_TEMP_MAX, RECEIVE_TEMP_LENGTH);
+        data->driver_temp_ = data->temp_;
     }
 }
 
 //结合motor_id和cmd形成CAN协议中的id
 //Form the can id with motor_id and cmd
-uint16_t FormCanId(uint8_t cmd, uint8_t motor_id){
+static inline uint16_t FormCanId(uint8_t cmd, uint8_t motor_id){
     return (cmd << CAN_ID_SHIFT_BITS) | motor_id;
 }
 
 //根据MotorCMD进行所发送can帧的填充
 //Fill in can frame with MotorCMD
-void MakeSendFrame(const MotorCMD *cmd, struct can_frame *frame_ret){
+static inline void MakeSendFrame(const MotorCMD *cmd, struct can_frame *frame_ret){
     frame_ret->can_id = FormCanId(cmd->cmd_, cmd->motor_id_);
     switch (cmd->cmd_)
     {
@@ -269,9 +340,16 @@ void MakeSendFrame(const MotorCMD *cmd, struct can_frame *frame_ret){
     }
 }
 
+//判断recv_frame是否为send_frame的应答，电机id和命令均需一致
+//Check whether recv_frame is the reply to send_frame, both motor id and cmd have to match
+static inline bool IsReplyFrame(const struct can_frame *send_frame, const struct can_frame *recv_frame){
+    return (recv_frame->can_id & 0x0f) == (send_frame->can_id & 0x0f) &&
+           ((recv_frame->can_id >> CAN_ID_SHIFT_BITS) & 0x3f) == ((send_frame->can_id >> CAN_ID_SHIFT_BITS) & 0x3f);
+}
+
 //根据收到的can帧进行MotorDATA的填充
 //Fill in MotorDATA with can frame received
-void ParseRecvFrame(const struct can_frame *frame_ret, MotorDATA *data){
+static inline void ParseRecvFrame(const struct can_frame *frame_ret, MotorDATA *data){
     uint32_t frame_id = frame_ret->can_id;
     uint32_t cmd = (frame_id >> CAN_ID_SHIFT_BITS) & 0x3f;
     uint32_t motor_id = frame_id & 0x0f;
@@ -309,6 +387,56 @@ void ParseRecvFrame(const struct can_frame *frame_ret, MotorDATA *data){
     }
 }
 
+enum CanBusState{
+    //*******************************
+    //CanBusState: can控制器的错误状态，由错误帧更新
+    //*******************************
+    //kCanBusErrorActive: 正常
+    //kCanBusErrorWarning: 错误计数达到警告等级
+    //kCanBusErrorPassive: 错误被动
+    //kCanBusOff: 总线关闭
+
+    //*******************************
+    //CanBusState: error state of the can controller, updated from error frames
+    //*******************************
+    //kCanBusErrorActive: normal
+    //kCanBusErrorWarning: error counters reached warning level
+    //kCanBusErrorPassive: error passive
+    //kCanBusOff: bus off
+    kCanBusErrorActive = 0,
+    kCanBusErrorWarning = 1,
+    kCanBusErrorPassive = 2,
+    kCanBusOff = 3
+};
+
+//can总线的健康统计
+//Health counters of a can bus
+typedef struct{
+    int state_;
+    uint32_t error_frames_;
+    uint32_t bus_off_;
+    uint32_t restarted_;
+    uint32_t arbitration_lost_;
+    uint32_t controller_errors_;
+    uint32_t rx_overflow_;
+    uint32_t tx_overflow_;
+    uint32_t protocol_errors_;
+    uint32_t transceiver_errors_;
+    uint32_t no_ack_;
+    uint32_t bus_errors_;
+    uint32_t tx_timeouts_;
+    uint8_t tx_error_counter_;
+    uint8_t rx_error_counter_;
+    uint32_t tx_buffer_full_;
+    uint32_t tx_backpressure_waits_;
+    uint32_t tx_dropped_;
+    bool tx_congested_;
+    int tx_queue_bytes_;
+    double tx_congested_stamp_;
+    int tx_congested_queue_bytes_;
+    double error_stamp_;
+}CanBusHealth;
+
 //DrMotorCan类，用于保存can的相关配置和资源
 //DrMotorCan struct, saving can configs and resources
 typedef struct{
@@ -316,14 +444,24 @@ typedef struct{
     int can_socket_;
     int epoll_fd_;
     pthread_mutex_t rw_mutex;
+    int send_budget_us_;
+    CanBusHealth health_;
+#ifdef DEEP_MOTOR_TRACE
+    MotorTrace trace_;
+#endif
 }DrMotorCan;
 
 //创建DrMotorCan实例
 //Create DrMotorCan object
-DrMotorCan* DrMotorCanCreate(const char *can_name, bool is_show_log){
+static inline DrMotorCan* DrMotorCanCreate(const char *can_name, bool is_show_log){
     DrMotorCan* can = (DrMotorCan*)malloc(sizeof(DrMotorCan));
     if(can != NULL){
         can->is_show_log_ = is_show_log;
+        can->send_budget_us_ = SEND_BUDGET_US;
+        memset(&can->health_, 0, sizeof(can->health_));
+#ifdef DEEP_MOTOR_TRACE
+        memset(&can->trace_, 0, sizeof(can->trace_));
+#endif
 
         if((can->can_socket_ = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0){
             printf("[ERROR] Socket creation failed\r\n");
@@ -353,6 +491,18 @@ DrMotorCan* DrMotorCanCreate(const char *can_name, bool is_show_log){
             exit(-1);
         }
 
+        can_err_mask_t err_mask = CAN_ERR_MASK;
+        if(setsockopt(can->can_socket_, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask)) < 0){
+            printf("[WARN] Enabling can error frames failed\r\n");
+        }
+
+        int timestamp_on = 1;
+        if(setsockopt(can->can_socket_, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp_on, sizeof(timestamp_on)) < 0){
+            printf("[WARN] Enabling kernel receive timestamps failed, replies are stamped after reading\r\n");
+        }
+
+        pthread_mutex_init(&can->rw_mutex, NULL);
+
         can->epoll_fd_ = epoll_create1(0);
         if(can->epoll_fd_ == -1){
             printf("[ERROR] Error creating epoll instance\r\n");
@@ -372,54 +522,356 @@ DrMotorCan* DrMotorCanCreate(const char *can_name, bool is_show_log){
 
 //销毁DrMotorCan实例
 //Destroy DrMotorCan object
-void DrMotorCanDestroy(DrMotorCan *can){
+static inline void DrMotorCanDestroy(DrMotorCan *can){
+    close(can->epoll_fd_);
     close(can->can_socket_);
+    pthread_mutex_destroy(&can->rw_mutex);
     free(can);
 }
 
-//使用DrMotorCan进行数据的发送和接收
-//Send and receive data via DrMotorCan
-int SendRecv(DrMotorCan *can, const MotorCMD *cmd, MotorDATA *data){
-    struct can_frame send_frame, recv_frame;
-    MakeSendFrame(cmd, &send_frame);
+#ifdef DEEP_MOTOR_TRACE
+//获取收发路径各阶段的计时统计
+//Get timing statistics of the phases of the send/receive path
+static inline void DrMotorCanGetTrace(DrMotorCan *can, MotorTrace *trace){
+    memcpy(trace, &can->trace_, sizeof(MotorTrace));
+}
+
+//清零收发路径各阶段的计时统计
+//Clear timing statistics of the phases of the send/receive path
+static inline void DrMotorCanResetTrace(DrMotorCan *can){
+    memset(&can->trace_, 0, sizeof(MotorTrace));
+}
+#endif
+
+//设置发送队列满时的最长等待时间，单位us
+//Set the max wait when the send queue is full, in us
+static inline void DrMotorCanSetSendBudget(DrMotorCan *can, int send_budget_us){
+    can->send_budget_us_ = send_budget_us;
+}
 
+//按时间和发送队列占用解除拥塞标记，并按时间恢复错误警告/被动状态，需持有rw_mutex。
+//tx_queue_bytes为当前发送队列占用的字节数，未知时为-1
+//Clear the congestion mark by time and send queue usage, and let error warning/passive state expire by time,
+//rw_mutex has to be held. tx_queue_bytes is the bytes currently held in the send queue, -1 if unknown
+static inline void ExpireCanBusHealth(CanBusHealth *health, double now, int tx_queue_bytes){
+    if(health->tx_congested_ &&
+       (now - health->tx_congested_stamp_ >= TX_CONGESTION_TIMEOUT_MS * 1e-3 ||
+        (tx_queue_bytes >= 0 && tx_queue_bytes < health->tx_congested_queue_bytes_))){
+        health->tx_congested_ = false;
+    }
+    if((health->state_ == kCanBusErrorWarning || health->state_ == kCanBusErrorPassive) &&
+       now - health->error_stamp_ >= CAN_STATE_EXPIRE_MS * 1e-3){
+        health->state_ = kCanBusErrorActive;
+    }
+}
+
+//发送队列占用的字节数，失败时返回-1
+//Bytes held in the send queue, -1 on failure
+static inline int CanTxQueueBytes(DrMotorCan *can){
+    int tx_queue_bytes = 0;
+    if(ioctl(can->can_socket_, SIOCOUTQ, &tx_queue_bytes) < 0){
+        return -1;
+    }
+    return tx_queue_bytes;
+}
+
+//获取can总线的健康统计，并读取当前发送队列占用的字节数
+//Get the health counters of the can bus, together with the bytes currently held in the send queue
+static inline void DrMotorCanGetHealth(DrMotorCan *can, CanBusHealth *health){
+    int tx_queue_bytes = CanTxQueueBytes(can);
+    double now = MotorClockNow();
+    pthread_mutex_lock(&can->rw_mutex);
+    ExpireCanBusHealth(&can->health_, now, tx_queue_bytes);
+    *health = can->health_;
+    pthread_mutex_unlock(&can->rw_mutex);
+    health->tx_queue_bytes_ = tx_queue_bytes;
+}
+
+//检查can总线的健康统计
+//Check health counters of the can bus
+static inline void CheckCanBusHealth(const char *can_name, const CanBusHealth *health){
+    switch (health->state_)
+    {
+    case kCanBusErrorWarning:
+        printf("[WARN] Can bus %s kCanBusErrorWarning\r\n", can_name);
+        break;
+    case kCanBusErrorPassive:
+        printf("[ERROR] Can bus %s kCanBusErrorPassive\r\n", can_name);
+        break;
+    case kCanBusOff:
+        printf("[ERROR] Can bus %s kCanBusOff\r\n", can_name);
+        break;
+    default:
+        break;
+    }
+    if(health->error_frames_ != 0 || health->tx_buffer_full_ != 0){
+        printf("[INFO] Can bus %s error_frames: %u, bus_off: %u, arbitration_lost: %u, no_ack: %u, protocol_errors: %u, "
+               "tec: %u, rec: %u, tx_buffer_full: %u, tx_dropped: %u, tx_queue_bytes: %d\r\n",
+            can_name, health->error_frames_, health->bus_off_, health->arbitration_lost_, health->no_ack_, health->protocol_errors_,
+            (uint32_t)health->tx_error_counter_, (uint32_t)health->rx_error_counter_,
+            health->tx_buffer_full_, health->tx_dropped_, health->tx_queue_bytes_);
+    }
+}
+
+//根据错误计数得到控制器的错误状态，阈值与CAN规范一致
+//Error state of the controller derived from its error counters, with the thresholds of the CAN specification
+static inline int CanBusStateFromCounters(uint8_t tx_error_counter, uint8_t rx_error_counter){
+    if(tx_error_counter >= 128 || rx_error_counter >= 128){
+        return kCanBusErrorPassive;
+    }
+    if(tx_error_counter >= 96 || rx_error_counter >= 96){
+        return kCanBusErrorWarning;
+    }
+    return kCanBusErrorActive;
+}
+
+//根据错误帧更新can总线的健康统计，now为MotorClockNow()的时间。
+//错误帧携带错误计数时按计数更新状态，因此驱动不上报CAN_ERR_CRTL_ACTIVE时状态也能恢复
+//Update health counters of the can bus with an error frame, now is MotorClockNow() time.
+//When the frame carries the error counters the state follows them, so it recovers even if the driver never
+//reports CAN_ERR_CRTL_ACTIVE
+static inline void DecodeErrorFrame(CanBusHealth *health, const struct can_frame *frame, double now){
+    canid_t err = frame->can_id & CAN_ERR_MASK;
+    health->error_frames_++;
+    health->error_stamp_ = now;
+    if(err & CAN_ERR_TX_TIMEOUT){
+        health->tx_timeouts_++;
+    }
+    if(err & CAN_ERR_LOSTARB){
+        health->arbitration_lost_++;
+    }
+    if(err & CAN_ERR_CRTL){
+        uint8_t ctrl = frame->data[1];
+        health->controller_errors_++;
+        if(ctrl & CAN_ERR_CRTL_RX_OVERFLOW){
+            health->rx_overflow_++;
+        }
+        if(ctrl & CAN_ERR_CRTL_TX_OVERFLOW){
+            health->tx_overflow_++;
+        }
+        if(ctrl & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE)){
+            health->state_ = kCanBusErrorPassive;
+        }
+        else if(ctrl & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING)){
+            health->state_ = kCanBusErrorWarning;
+        }
+#ifdef CAN_ERR_CRTL_ACTIVE
+        else if(ctrl & CAN_ERR_CRTL_ACTIVE){
+            health->state_ = kCanBusErrorActive;
+        }
+#endif
+    }
+#ifdef CAN_ERR_CNT
+    if(err & CAN_ERR_CNT){
+        health->tx_error_counter_ = frame->data[6];
+        health->rx_error_counter_ = frame->data[7];
+        if(health->state_ != kCanBusOff){
+            health->state_ = CanBusStateFromCounters(frame->data[6], frame->data[7]);
+        }
+    }
+#endif
+    if(err & CAN_ERR_PROT){
+        health->protocol_errors_++;
+    }
+    if(err & CAN_ERR_TRX){
+        health->transceiver_errors_++;
+    }
+    if(err & CAN_ERR_ACK){
+        health->no_ack_++;
+    }
+    if(err & CAN_ERR_BUSERROR){
+        health->bus_errors_++;
+    }
+    if(err & CAN_ERR_BUSOFF){
+        health->bus_off_++;
+        health->state_ = kCanBusOff;
+    }
+    if(err & CAN_ERR_RESTARTED){
+        health->restarted_++;
+        health->state_ = kCanBusErrorActive;
+    }
+}
+
+//查询类命令为低优先级，总线拥塞时优先丢弃
+//Query cmds are low priority and are dropped first when the bus is congested
+static inline bool IsLowPriorityCmd(uint32_t cmd){
+    return cmd == GET_STATUS_WORD || cmd == GET_FW_VERSION || cmd == GET_CONFIG;
+}
+
+//在已持有rw_mutex时写出一帧，now为调用时MotorClockNow()的时间，等待后更新为当前时间。发送队列满时，低优先级的查询被丢弃，
+//其他帧按固定间隔睡眠重试，直到deadline(MotorClockNow()的时间)，仅在睡眠期间释放rw_mutex，返回时仍持有。
+//拥塞标记在TX_CONGESTION_TIMEOUT_MS后或发送队列占用下降时解除
+//Write one frame with rw_mutex already held, now is MotorClockNow() time of the call and is updated after waiting. When the send queue is full,
+//low priority queries are dropped and other frames are retried at a fixed sleep interval until deadline
+//(MotorClockNow() time). rw_mutex is released only while sleeping and is held again on return. The congestion mark
+//clears after TX_CONGESTION_TIMEOUT_MS or once the send queue drains
+static inline int WriteFrameLocked(DrMotorCan *can, const struct can_frame *frame, double *now, double deadline){
+    bool is_low_priority = IsLowPriorityCmd((frame->can_id >> CAN_ID_SHIFT_BITS) & 0x3f);
+    bool is_retry = false;
+    while(true){
+        if(is_low_priority){
+            ExpireCanBusHealth(&can->health_, *now, can->health_.tx_congested_ ? CanTxQueueBytes(can) : -1);
+            if(can->health_.tx_congested_ || can->health_.state_ >= kCanBusErrorPassive){
+                can->health_.tx_dropped_++;
+                return kSendBusyError;
+            }
+        }
+        TRACE_BEGIN(write_start, kTraceWrite);
+        ssize_t nbytes = write(can->can_socket_, frame, sizeof(*frame));
+        int write_errno = errno;
+        TRACE_END(&can->trace_, write_start, kTraceWrite);
+        if(nbytes == sizeof(*frame)){
+            can->health_.tx_congested_ = false;
+            return kNoSendRecvError;
+        }
+        if(nbytes >= 0 || (write_errno != ENOBUFS && write_errno != EAGAIN)){
+            return kSendLengthError;
+        }
+        can->health_.tx_buffer_full_++;
+        can->health_.tx_congested_ = true;
+        can->health_.tx_congested_stamp_ = *now;
+        can->health_.tx_congested_queue_bytes_ = CanTxQueueBytes(can);
+        if(!is_retry && !is_low_priority){
+            can->health_.tx_backpressure_waits_++;
+        }
+        if(is_low_priority || *now >= deadline){
+            return kSendBusyError;
+        }
+
+        //socketcan没有设备队列出现空位的通知(队列满时poll仍可能报告可写)，因此等待为睡眠重试，不超过剩余时间
+        //socketcan gives no notification when the device queue frees up (poll may report writable while it is full),
+        //so the wait is a sleep and retry, never longer than the remaining time
+        pthread_mutex_unlock(&can->rw_mutex);
+        double remaining_us = (deadline - *now) * 1e6;
+        usleep(remaining_us < SEND_RETRY_INTERVAL_US ? (useconds_t)remaining_us + 1 : SEND_RETRY_INTERVAL_US);
+        is_retry = true;
+        TRACE_BEGIN(lock_start, kTraceLockWait);
+        pthread_mutex_lock(&can->rw_mutex);
+        TRACE_END(&can->trace_, lock_start, kTraceLockWait);
+        *now = MotorClockNow();
+    }
+}
+
+//写出一帧，见WriteFrameLocked()
+//Write one frame, see WriteFrameLocked()
+static inline int WriteFrame(DrMotorCan *can, const struct can_frame *frame, double deadline){
+    double now = MotorClockNow();
+    TRACE_BEGIN(lock_start, kTraceLockWait);
+    pthread_mutex_lock(&can->rw_mutex);
+    TRACE_END(&can->trace_, lock_start, kTraceLockWait);
+    int ret = WriteFrameLocked(can, frame, &now, deadline);
+    pthread_mutex_unlock(&can->rw_mutex);
+    return ret;
+}
+
+//读出一帧数据帧，错误帧在读取时被统计并跳过。stamp为内核的接收时间，换算为MotorClockNow()的时间，可为NULL。
+//返回1: 读到数据帧，0: 无可读帧，-1: 长度错误
+//Read one data frame, error frames are counted and skipped on the way. stamp is the kernel receive time converted into
+//MotorClockNow() time, may be NULL. Return 1: data frame read, 0: nothing to read, -1: length error
+static inline int ReadFrame(DrMotorCan *can, struct can_frame *frame, double *stamp){
+    while(true){
+        struct iovec iov;
+        iov.iov_base = frame;
+        iov.iov_len = sizeof(*frame);
+        char control[CMSG_SPACE(sizeof(struct timespec))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        TRACE_BEGIN(lock_start, kTraceLockWait);
+        pthread_mutex_lock(&can->rw_mutex);
+        TRACE_END(&can->trace_, lock_start, kTraceLockWait);
+        TRACE_BEGIN(read_start, kTraceRead);
+        ssize_t nbytes = recvmsg(can->can_socket_, &msg, 0);
+        int read_errno = errno;
+        TRACE_END(&can->trace_, read_start, kTraceRead);
+        bool is_error_frame = nbytes == sizeof(*frame) && (frame->can_id & CAN_ERR_FLAG);
+        if(is_error_frame){
+            DecodeErrorFrame(&can->health_, frame, MotorClockNow());
+        }
+        pthread_mutex_unlock(&can->rw_mutex);
+        if(is_error_frame){
+            continue;
+        }
+        if(nbytes == sizeof(*frame)){
+            if(stamp != NULL){
+                *stamp = 0;
+                for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+                    if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS){
+                        struct timespec ts;
+                        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                        *stamp = MotorClockFromRealtime(&ts);
+                    }
+                }
+                if(*stamp == 0){
+                    *stamp = MotorClockNow();
+                }
+            }
+            return 1;
+        }
+        if(nbytes < 0 && (read_errno == EAGAIN || read_errno == EWOULDBLOCK)){
+            return 0;
+        }
+        return -1;
+    }
+}
+
+//使用DrMotorCan发送一帧并接收其应答，不做编解码，recv_stamp可为NULL。
+//电机id或命令不一致的帧(其他线程或上一周期的应答)被丢弃，直到超时
+//Send one frame and receive its reply via DrMotorCan, without encoding or decoding, recv_stamp may be NULL.
+//Frames with another motor id or cmd (replies for other threads or the previous cycle) are dropped until the timeout
+static inline int SendRecvFrame(DrMotorCan *can, const struct can_frame *send_frame, struct can_frame *recv_frame, double *recv_stamp){
     struct timeval start_time;
     gettimeofday(&start_time, NULL);
 
     if(can->is_show_log_){
         printf("[INFO] Writing frame with can_id: %d, can_dlc: %d, data: %d, %d, %d, %d, %d, %d, %d, %d",
-            send_frame.can_id, send_frame.can_dlc,
-            (uint32_t)send_frame.data[0], (uint32_t)send_frame.data[1], (uint32_t)send_frame.data[2], (uint32_t)send_frame.data[3],
-            (uint32_t)send_frame.data[4], (uint32_t)send_frame.data[5], (uint32_t)send_frame.data[6], (uint32_t)send_frame.data[7]
+            send_frame->can_id, send_frame->can_dlc,
+            (uint32_t)send_frame->data[0], (uint32_t)send_frame->data[1], (uint32_t)send_frame->data[2], (uint32_t)send_frame->data[3],
+            (uint32_t)send_frame->data[4], (uint32_t)send_frame->data[5], (uint32_t)send_frame->data[6], (uint32_t)send_frame->data[7]
         );
     }
-    
-    pthread_mutex_lock(&can->rw_mutex);
-    ssize_t nbytes1 = write(can->can_socket_, &send_frame, sizeof(send_frame));
-    pthread_mutex_unlock(&can->rw_mutex);
-    if(nbytes1 != sizeof(send_frame)){
-        return kSendLengthError;
+
+    int ret = WriteFrame(can, send_frame, MotorClockNow() + can->send_budget_us_ * 1e-6);
+    if(ret != kNoSendRecvError){
+        return ret;
     }
 
-    struct epoll_event events;
-    int epoll_wait_result = epoll_wait(can->epoll_fd_, &events, 5, 3);
-    if(epoll_wait_result == 0){
-        return kRecvTimeoutError;
-    }else if (epoll_wait_result == -1){
-        return kRecvEpollError;
-    }else{
-        pthread_mutex_lock(&can->rw_mutex);
-        ssize_t nbytes2 = read(can->can_socket_, &recv_frame, sizeof(recv_frame));
-        pthread_mutex_unlock(&can->rw_mutex);
-        if(nbytes2 != sizeof(recv_frame)){
+    double deadline = MotorClockNow() + RECV_TIMEOUT_MS * 1e-3;
+    while(true){
+        int timeout_ms = (int)((deadline - MotorClockNow()) * 1e3 + 0.999);
+        if(timeout_ms <= 0){
+            return kRecvTimeoutError;
+        }
+        struct epoll_event events;
+        TRACE_BEGIN(epoll_start, kTraceEpollWait);
+        int epoll_wait_result = epoll_wait(can->epoll_fd_, &events, 1, timeout_ms);
+        TRACE_END(&can->trace_, epoll_start, kTraceEpollWait);
+        if(epoll_wait_result == 0){
+            return kRecvTimeoutError;
+        }else if (epoll_wait_result == -1){
+            return kRecvEpollError;
+        }
+
+        int read_result = ReadFrame(can, recv_frame, recv_stamp);
+        if(read_result == 0){
+            continue;
+        }
+        if(read_result < 0){
             return kRecvLengthError;
         }
+        if(!IsReplyFrame(send_frame, recv_frame)){
+            continue;
+        }
 
         if(can->is_show_log_){
             printf("[INFO] Reading frame with can_id: %d, can_dlc: %d, data: %d, %d, %d, %d, %d, %d, %d, %d\r\n",
-                recv_frame.can_id, recv_frame.can_dlc,
-                (uint32_t)recv_frame.data[0], (uint32_t)recv_frame.data[1], (uint32_t)recv_frame.data[2], (uint32_t)recv_frame.data[3],
-                (uint32_t)recv_frame.data[4], (uint32_t)recv_frame.data[5], (uint32_t)recv_frame.data[6], (uint32_t)recv_frame.data[7]
+                recv_frame->can_id, recv_frame->can_dlc,
+                (uint32_t)recv_frame->data[0], (uint32_t)recv_frame->data[1], (uint32_t)recv_frame->data[2], (uint32_t)recv_frame->data[3],
+                (uint32_t)recv_frame->data[4], (uint32_t)recv_frame->data[5], (uint32_t)recv_frame->data[6], (uint32_t)recv_frame->data[7]
             );
             struct timeval end_time;
             gettimeofday(&end_time, NULL);
@@ -427,8 +879,142 @@ int SendRecv(DrMotorCan *can, const MotorCMD *cmd, MotorDATA *data){
                         (end_time.tv_usec - start_time.tv_usec);
             printf("[INFO] SendRecv() t_diff: %lld us\r\n", duration_us);
         }
-
-        ParseRecvFrame(&recv_frame, data);
         return kNoSendRecvError;
     }
 }
+
+//使用DrMotorCan进行数据的发送和接收
+//Send and receive data via DrMotorCan
+static inline int SendRecv(DrMotorCan *can, const MotorCMD *cmd, MotorDATA *data){
+    TRACE_BEGIN(total_start, kTraceTotal);
+    struct can_frame send_frame, recv_frame;
+    TRACE_BEGIN(encode_start, kTraceEncode);
+    MakeSendFrame(cmd, &send_frame);
+    TRACE_END(&can->trace_, encode_start, kTraceEncode);
+
+    double stamp;
+    int ret = SendRecvFrame(can, &send_frame, &recv_frame, &stamp);
+    if(ret != kNoSendRecvError){
+        TRACE_END(&can->trace_, total_start, kTraceTotal);
+        return ret;
+    }
+
+    TRACE_BEGIN(decode_start, kTraceDecode);
+    ParseRecvFrame(&recv_frame, data);
+    TRACE_END(&can->trace_, decode_start, kTraceDecode);
+    if(data->cmd_ == CONTROL_MOTOR){
+        data->stamp_ = stamp;
+    }
+    TRACE_END(&can->trace_, total_start, kTraceTotal);
+    return kNoSendRecvError;
+}
+
+//连续写出num帧后统一接收应答，按电机id和命令匹配，其他帧(上一周期迟到的应答、其他线程的查询应答)被丢弃，不做编解码。
+//rets[i]为第i帧的结果，recv_stamps[i]为其应答的接收时间，返回收到的应答数量。超过MAX_BURST_FRAMES的帧不发送，rets为kBurstSizeError
+//Write num frames back to back, then collect the replies matched by motor id and cmd, other frames (late replies of
+//the previous cycle, replies to queries of other threads) are dropped, without encoding or decoding.
+//rets[i] is the result of the i-th frame and recv_stamps[i] the receive time of its reply, return the number of replies received.
+//Frames beyond MAX_BURST_FRAMES are not sent and get kBurstSizeError
+static inline int SendRecvFrames(DrMotorCan *can, const struct can_frame *send_frames, struct can_frame *recv_frames,
+                                 double *recv_stamps, int *rets, int num){
+    for(int i = MAX_BURST_FRAMES; i < num; i++){
+        rets[i] = kBurstSizeError;
+    }
+    if(num > MAX_BURST_FRAMES){
+        num = MAX_BURST_FRAMES;
+    }
+    //整个突发只加锁一次，其他线程的帧不会插入其中，除非发送队列满时等待
+    //The lock is taken once for the whole burst, so frames of other threads cannot slip in unless it waits on a full send queue
+    int pending = 0;
+    double now = MotorClockNow();
+    double send_deadline = now + can->send_budget_us_ * 1e-6;
+    TRACE_BEGIN(lock_start, kTraceLockWait);
+    pthread_mutex_lock(&can->rw_mutex);
+    TRACE_END(&can->trace_, lock_start, kTraceLockWait);
+    for(int i = 0; i < num; i++){
+        rets[i] = WriteFrameLocked(can, &send_frames[i], &now, send_deadline);
+        if(rets[i] == kNoSendRecvError){
+            rets[i] = kRecvTimeoutError;
+            pending++;
+        }
+    }
+    pthread_mutex_unlock(&can->rw_mutex);
+
+    int received = 0;
+    double deadline = MotorClockNow() + RECV_TIMEOUT_MS * 1e-3;
+    while(pending > 0){
+        int timeout_ms = (int)((deadline - MotorClockNow()) * 1e3 + 0.999);
+        if(timeout_ms <= 0){
+            break;
+        }
+        struct epoll_event events;
+        TRACE_BEGIN(epoll_start, kTraceEpollWait);
+        int epoll_wait_result = epoll_wait(can->epoll_fd_, &events, 1, timeout_ms);
+        TRACE_END(&can->trace_, epoll_start, kTraceEpollWait);
+        if(epoll_wait_result == 0){
+            break;
+        }else if(epoll_wait_result == -1){
+            for(int i = 0; i < num; i++){
+                if(rets[i] == kRecvTimeoutError){
+                    rets[i] = kRecvEpollError;
+                }
+            }
+            break;
+        }
+
+        struct can_frame frame;
+        double stamp;
+        while(pending > 0){
+            if(ReadFrame(can, &frame, &stamp) != 1){
+                break;
+            }
+            for(int i = 0; i < num; i++){
+                if(rets[i] == kRecvTimeoutError && IsReplyFrame(&send_frames[i], &frame)){
+                    recv_frames[i] = frame;
+                    recv_stamps[i] = stamp;
+                    rets[i] = kNoSendRecvError;
+                    pending--;
+                    received++;
+                    break;
+                }
+            }
+        }
+    }
+    return received;
+}
+
+//向同一总线上的num个关节连续发送命令后统一接收应答，以减小关节间的采样时间差。
+//rets[i]为第i个关节的SendRecvRet，返回收到的应答数量。超过MAX_BURST_FRAMES的关节不发送，rets为kBurstSizeError
+//Send cmds to num motors on the same bus back to back and then collect the replies, minimizing the sample skew between motors.
+//rets[i] is the SendRecvRet of the i-th motor, return the number of replies received.
+//Motors beyond MAX_BURST_FRAMES are not sent and get kBurstSizeError
+static inline int SendRecvBurst(DrMotorCan *can, const MotorCMD *cmds, MotorDATA *data, int *rets, int num){
+    struct can_frame send_frames[MAX_BURST_FRAMES], recv_frames[MAX_BURST_FRAMES];
+    double stamps[MAX_BURST_FRAMES];
+    for(int i = MAX_BURST_FRAMES; i < num; i++){
+        rets[i] = kBurstSizeError;
+    }
+    if(num > MAX_BURST_FRAMES){
+        num = MAX_BURST_FRAMES;
+    }
+    TRACE_BEGIN(total_start, kTraceTotal);
+    TRACE_BEGIN(encode_start, kTraceEncode);
+    for(int i = 0; i < num; i++){
+        MakeSendFrame(&cmds[i], &send_frames[i]);
+    }
+    TRACE_END(&can->trace_, encode_start, kTraceEncode);
+
+    int received = SendRecvFrames(can, send_frames, recv_frames, stamps, rets, num);
+    TRACE_BEGIN(decode_start, kTraceDecode);
+    for(int i = 0; i < num; i++){
+        if(rets[i] == kNoSendRecvError){
+            ParseRecvFrame(&recv_frames[i], &data[i]);
+            if(data[i].cmd_ == CONTROL_MOTOR){
+                data[i].stamp_ = stamps[i];
+            }
+        }
+    }
+    TRACE_END(&can->trace_, decode_start, kTraceDecode);
+    TRACE_END(&can->trace_, total_start, kTraceTotal);
+    return received;
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+// C++17 接口: 编译期确定关节数量的MotorBus模板和constexpr编解码
+// C++17 interface: MotorBus template with compile-time motor count and constexpr codec
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "deep_motor_sdk.h"
+#include "motor_snapshot.h"
+
+namespace deep_motor {
+
+//协议字段描述: 取值范围和位宽
+//Protocol field descriptor: value range and bit width
+struct FieldDesc
+{
+    float min_;
+    float max_;
+    uint8_t bits_;
+
+    constexpr uint32_t MaxUint() const { return (1u << bits_) - 1u; }
+
+    //float转uint，超出范围的值被限幅
+    //float to uint, out-of-range values are clamped
+    constexpr uint32_t Encode(float x) const {
+        if(x <= min_) return 0;
+        if(x >= max_) return MaxUint();
+        return (uint32_t)((x - min_) * ((float)MaxUint()) / (max_ - min_));
+    }
+
+    //uint转float
+    //uint to float
+    constexpr float Decode(uint32_t x) const {
+        return ((float)x) * (max_ - min_) / ((float)MaxUint()) + min_;
+    }
+};
+
+//发送和接收的各字段描述，由can_protocol.h中的常量生成
+//Descriptors of sent and received fields, generated from constants in can_protocol.h
+namespace field {
+inline constexpr FieldDesc kSendPosition{POSITION_MIN, POSITION_MAX, SEND_POSITION_LENGTH};
+inline constexpr FieldDesc kSendVelocity{VELOCITY_MIN, VELOCITY_MAX, SEND_VELOCITY_LENGTH};
+inline constexpr FieldDesc kSendKp{KP_MIN, KP_MAX, SEND_KP_LENGTH};
+inline constexpr FieldDesc kSendKd{KD_MIN, KD_MAX, SEND_KD_LENGTH};
+inline constexpr FieldDesc kSendTorque{TORQUE_MIN, TORQUE_MAX, SEND_TORQUE_LENGTH};
+
+inline constexpr FieldDesc kRecvPosition{POSITION_MIN, POSITION_MAX, RECEIVE_POSITION_LENGTH};
+inline constexpr FieldDesc kRecvVelocity{VELOCITY_MIN, VELOCITY_MAX, RECEIVE_VELOCITY_LENGTH};
+inline constexpr FieldDesc kRecvTorque{TORQUE_MIN, TORQUE_MAX, RECEIVE_TORQUE_LENGTH};
+inline constexpr FieldDesc kRecvMotorTemp{MOTOR_TEMP_MIN, MOTOR_TEMP_MAX, RECEIVE_TEMP_LENGTH};
+inline constexpr FieldDesc kRecvDriverTemp{DRIVER_TEMP_MIN, DRIVER_TEMP_MAX, RECEIVE_TEMP_LENGTH};
+} // namespace field
+
+static_assert(SEND_POSITION_LENGTH + SEND_VELOCITY_LENGTH + SEND_KP_LENGTH +
+              SEND_KD_LENGTH + SEND_TORQUE_LENGTH == 64, "motion cmd must fill 8 bytes");
+static_assert(RECEIVE_POSITION_LENGTH + RECEIVE_VELOCITY_LENGTH + RECEIVE_TORQUE_LENGTH +
+              RECEIVE_TEMP_FLAG_LENGTH + RECEIVE_TEMP_LENGTH == 64, "motion reply must fill 8 bytes");
+
+//运动命令的8字节负载，与FloatsToUints()的布局一致
+//8-byte payload of a motion cmd, same layout as FloatsToUints()
+constexpr std::array<uint8_t, 8> EncodeMotion(float position, float velocity, float torque, float kp, float kd){
+    const uint32_t p = field::kSendPosition.Encode(position);
+    const uint32_t v = field::kSendVelocity.Encode(velocity);
+    const uint32_t t = field::kSendTorque.Encode(torque);
+    const uint32_t k_p = field::kSendKp.Encode(kp);
+    const uint32_t k_d = field::kSendKd.Encode(kd);
+    return {{
+        (uint8_t)p,
+        (uint8_t)(p >> 8),
+        (uint8_t)v,
+        (uint8_t)(((v >> 8) & 0x3f) | ((k_p & 0x03) << 6)),
+        (uint8_t)(k_p >> 2),
+        (uint8_t)k_d,
+        (uint8_t)t,
+        (uint8_t)(t >> 8),
+    }};
+}
+
+//运动应答的解码结果
+//Decoded motion reply
+struct MotionReply
+{
+    float position_;
+    float velocity_;
+    float torque_;
+    bool flag_;
+    float temp_;
+};
+
+//解码运动应答的8字节负载，与UintsToFloats()的布局一致
+//Decode the 8-byte payload of a motion reply, same layout as UintsToFloats()
+constexpr MotionReply DecodeMotion(const uint8_t *d){
+    const uint32_t p = (uint32_t)d[0] | ((uint32_t)d[1] << 8) | (((uint32_t)d[2] & 0x0f) << 16);
+    const uint32_t v = ((uint32_t)d[2] >> 4) | ((uint32_t)d[3] << 4) | ((uint32_t)d[4] << 12);
+    const uint32_t t = (uint32_t)d[5] | ((uint32_t)d[6] << 8);
+    const bool flag = (d[7] & 0x01) != 0;
+    const uint32_t temp = (uint32_t)d[7] >> 1;
+    return MotionReply{
+        field::kRecvPosition.Decode(p),
+        field::kRecvVelocity.Decode(v),
+        field::kRecvTorque.Decode(t),
+        flag,
+        flag == kMotorTempFlag ? field::kRecvMotorTemp.Decode(temp) : field::kRecvDriverTemp.Decode(temp),
+    };
+}
+
+//命令在发送时的DLC，不支持的命令在编译期报错
+//DLC of a cmd when sent, unsupported cmds fail at compile time
+template <uint8_t Cmd>
+constexpr uint8_t SendDlc(){
+    static_assert(Cmd == ENABLE_MOTOR || Cmd == DISABLE_MOTOR || Cmd == SET_HOME ||
+                  Cmd == ERROR_RESET || Cmd == CONTROL_MOTOR || Cmd == GET_STATUS_WORD,
+                  "cmd is not supported by MotorBus");
+    if constexpr (Cmd == ENABLE_MOTOR) return SEND_DLC_ENABLE_MOTOR;
+    else if constexpr (Cmd == DISABLE_MOTOR) return SEND_DLC_DISABLE_MOTOR;
+    else if constexpr (Cmd == SET_HOME) return SEND_DLC_SET_HOME;
+    else if constexpr (Cmd == ERROR_RESET) return SEND_DLC_ERROR_RESET;
+    else if constexpr (Cmd == CONTROL_MOTOR) return SEND_DLC_CONTROL_MOTOR;
+    else return SEND_DLC_GET_STATUS_WORD;
+}
+
+namespace detail {
+constexpr bool Near(float a, float b, float eps){
+    return a - b < eps && b - a < eps;
+}
+
+constexpr bool RoundTripCheck(){
+    //发送和接收的速度位宽不同，仅检查位置/力矩的往返
+    //Send and receive velocity widths differ, only position/torque round trip is checked
+    const std::array<uint8_t, 8> d = EncodeMotion(1.5f, 0.0f, -2.0f, 0.0f, 0.0f);
+    const uint32_t p = (uint32_t)d[0] | ((uint32_t)d[1] << 8);
+    const uint32_t t = (uint32_t)d[6] | ((uint32_t)d[7] << 8);
+    return Near(field::kSendPosition.Decode(p), 1.5f, 0.01f) &&
+           Near(field::kSendTorque.Decode(t), -2.0f, 0.01f);
+}
+static_assert(RoundTripCheck(), "constexpr codec round trip");
+} // namespace detail
+
+//DrMotorCan的RAII封装，析构时关闭socket
+//RAII wrapper of DrMotorCan, socket is closed on destruction
+class CanSocket
+{
+public:
+    CanSocket(const char *can_name, bool is_show_log)
+        : can_(DrMotorCanCreate(can_name, is_show_log)) {}
+
+    CanSocket(const CanSocket &) = delete;
+    CanSocket &operator=(const CanSocket &) = delete;
+    CanSocket(CanSocket &&) = default;
+    CanSocket &operator=(CanSocket &&) = default;
+
+    DrMotorCan *get() const { return can_.get(); }
+
+private:
+    struct Deleter
+    {
+        void operator()(DrMotorCan *can) const { DrMotorCanDestroy(can); }
+    };
+    std::unique_ptr<DrMotorCan, Deleter> can_;
+};
+
+//同一CAN总线上N个关节的命令和状态，N在编译期确定
+//Cmds and states of N motors on one can bus, N is fixed at compile time
+template <std::size_t N>
+class MotorBus
+{
+public:
+    MotorBus(const char *can_name, const std::array<uint8_t, N> &motor_ids, bool is_show_log = false)
+        : socket_(can_name, is_show_log), motor_ids_(motor_ids), cmd_(), data_(), ret_() {
+        for(std::size_t i = 0; i < N; i++){
+            cmd_[i].motor_id_ = motor_ids_[i];
+            cmd_[i].cmd_ = CONTROL_MOTOR;
+            data_[i].motor_id_ = motor_ids_[i];
+            data_[i].error_ = kMotorNoError;
+        }
+    }
+
+    static constexpr std::size_t size() { return N; }
+
+    //写入第i个关节的控制命令，在下一次Control()时发送
+    //Write control cmd of the i-th motor, sent at the next Control()
+    void SetMotion(std::size_t i, float position, float velocity, float torque, float kp, float kd){
+        SetMotionCMD(&cmd_[i], motor_ids_[i], CONTROL_MOTOR, position, velocity, torque, kp, kd);
+    }
+
+    //向第i个关节发送命令Cmd并接收应答
+    //Send cmd Cmd to the i-th motor and receive the reply
+    template <uint8_t Cmd>
+    int Send(std::size_t i){
+        DrMotorCan *can = socket_.get();
+        TRACE_BEGIN(total_start, kTraceTotal);
+        struct can_frame send_frame, recv_frame;
+        TRACE_BEGIN(encode_start, kTraceEncode);
+        MakeFrame<Cmd>(i, send_frame);
+        TRACE_END(&can->trace_, encode_start, kTraceEncode);
+
+        double stamp;
+        const int ret = SendRecvFrame(can, &send_frame, &recv_frame, &stamp);
+        if(ret == kNoSendRecvError){
+            TRACE_BEGIN(decode_start, kTraceDecode);
+            Decode<Cmd>(recv_frame, data_[i]);
+            TRACE_END(&can->trace_, decode_start, kTraceDecode);
+            if(data_[i].cmd_ == CONTROL_MOTOR){
+                data_[i].stamp_ = stamp;
+            }
+        }
+        ret_[i] = ret;
+        TRACE_END(&can->trace_, total_start, kTraceTotal);
+        return ret;
+    }
+
+    //向所有关节依次发送命令Cmd，循环在编译期展开
+    //Send cmd Cmd to all motors in turn, the loop is unrolled at compile time
+    template <uint8_t Cmd>
+    const std::array<int, N> &SendAll(){
+        SendAllImpl<Cmd>(std::make_index_sequence<N>{});
+        return ret_;
+    }
+
+    //连续写出所有关节的命令Cmd后统一接收应答，减小关节间的采样时间差
+    //Write cmd Cmd of all motors back to back and then collect the replies, minimizing the sample skew between motors
+    template <uint8_t Cmd>
+    const std::array<int, N> &SendBurst(){
+        static_assert(N <= MAX_BURST_FRAMES, "too many motors for one burst");
+        std::array<struct can_frame, N> send_frames, recv_frames;
+        std::array<double, N> stamps;
+        DrMotorCan *can = socket_.get();
+        TRACE_BEGIN(total_start, kTraceTotal);
+        TRACE_BEGIN(encode_start, kTraceEncode);
+        for(std::size_t i = 0; i < N; i++){
+            MakeFrame<Cmd>(i, send_frames[i]);
+        }
+        TRACE_END(&can->trace_, encode_start, kTraceEncode);
+
+        SendRecvFrames(can, send_frames.data(), recv_frames.data(), stamps.data(), ret_.data(), (int)N);
+        TRACE_BEGIN(decode_start, kTraceDecode);
+        for(std::size_t i = 0; i < N; i++){
+            if(ret_[i] == kNoSendRecvError){
+                Decode<Cmd>(recv_frames[i], data_[i]);
+                if(data_[i].cmd_ == CONTROL_MOTOR){
+                    data_[i].stamp_ = stamps[i];
+                }
+            }
+        }
+        TRACE_END(&can->trace_, decode_start, kTraceDecode);
+        TRACE_END(&can->trace_, total_start, kTraceTotal);
+        return ret_;
+    }
+
+    //发送所有关节的控制命令，即每个控制周期的调用
+    //Send control cmds of all motors, i.e. the per-cycle call
+    const std::array<int, N> &Control() { return SendAll<CONTROL_MOTOR>(); }
+
+    //以突发方式发送所有关节的控制命令
+    //Send control cmds of all motors as one burst
+    const std::array<int, N> &ControlBurst() { return SendBurst<CONTROL_MOTOR>(); }
+
+    //获取所有关节状态的快照，见MotorSnapshotTake()
+    //Take a snapshot of all motor states, see MotorSnapshotTake()
+    MotorSnapshotInfo Snapshot(std::array<MotorDATA, N> &snapshot, double ref_stamp = 0, bool extrapolate = false,
+                               double max_age = 0) const {
+        MotorSnapshotInfo info;
+        MotorSnapshotTake(data_.data(), (int)N, ref_stamp, max_age, extrapolate, snapshot.data(), &info);
+        return info;
+    }
+
+    uint8_t motor_id(std::size_t i) const { return motor_ids_[i]; }
+    const MotorCMD &cmd(std::size_t i) const { return cmd_[i]; }
+    const MotorDATA &data(std::size_t i) const { return data_[i]; }
+    const std::array<MotorDATA, N> &data() const { return data_; }
+    const std::array<int, N> &last_ret() const { return ret_; }
+    DrMotorCan *can() const { return socket_.get(); }
+
+    //总线的健康统计，见DrMotorCanGetHealth()
+    //Health counters of the bus, see DrMotorCanGetHealth()
+    CanBusHealth health() const {
+        CanBusHealth health;
+        DrMotorCanGetHealth(socket_.get(), &health);
+        return health;
+    }
+
+private:
+    template <uint8_t Cmd>
+    void MakeFrame(std::size_t i, struct can_frame &frame) const {
+        frame.can_id = FormCanId(Cmd, motor_ids_[i]);
+        frame.can_dlc = SendDlc<Cmd>();
+        if constexpr (Cmd == CONTROL_MOTOR){
+            const MotorCMD &c = cmd_[i];
+            const std::array<uint8_t, 8> d = EncodeMotion(c.position_, c.velocity_, c.torque_, c.kp_, c.kd_);
+            for(std::size_t k = 0; k < 8; k++){
+                frame.data[k] = d[k];
+            }
+        }
+    }
+
+    template <uint8_t Cmd>
+    static void Decode(const struct can_frame &frame, MotorDATA &data){
+        if constexpr (Cmd == CONTROL_MOTOR){
+            const uint32_t cmd = (frame.can_id >> CAN_ID_SHIFT_BITS) & 0x3f;
+            data.motor_id_ = frame.can_id & 0x0f;
+            data.cmd_ = cmd;
+            if(cmd != CONTROL_MOTOR){
+                ParseRecvFrame(&frame, &data);
+                return;
+            }
+            const MotionReply r = DecodeMotion(frame.data);
+            data.position_ = r.position_;
+            data.velocity_ = r.velocity_;
+            data.torque_ = r.torque_;
+            data.flag_ = r.flag_;
+            data.temp_ = r.temp_;
+            if(r.flag_ == kMotorTempFlag){
+                data.motor_temp_ = r.temp_;
+            }
+            else{
+                data.driver_temp_ = r.temp_;
+            }
+        }
+        else{
+            ParseRecvFrame(&frame, &data);
+        }
+    }
+
+    template <uint8_t Cmd, std::size_t... I>
+    void SendAllImpl(std::index_sequence<I...>){
+        (Send<Cmd>(I), ...);
+    }
+
+    CanSocket socket_;
+    std::array<uint8_t, N> motor_ids_;
+    std::array<MotorCMD, N> cmd_;
+    std::array<MotorDATA, N> data_;
+    std::array<int, N> ret_;
+};
+
+} // namespace deep_motor
@@ -0,0 +1,573 @@
+#pragma once
+
+#include <poll.h>
+
+#include "deep_motor_sdk.h"
+
+//急停支持的最大can总线数量
+//Max number of can buses supported by the e-stop
+#ifndef ESTOP_MAX_BUSES
+#define ESTOP_MAX_BUSES 4
+#endif
+
+//每条总线上的最大关节数量，与电机id的4位宽度一致
+//Max number of motors per bus, matching the 4-bit motor id
+#define ESTOP_MAX_MOTORS 16
+
+//未收到应答时重发急停帧的间隔，单位ms
+//Interval of resending e-stop frames to motors that have not replied, in ms
+#define ESTOP_RESEND_MS 3
+
+//最大重发次数，之后急停被标记为未确认
+//Max number of resends, after which the e-stop is marked unconfirmed
+#define ESTOP_MAX_RESENDS 5
+
+enum EStopMode{
+    //*******************************
+    //EStopMode: 急停时发送的命令
+    //*******************************
+    //kEStopDisable: 发送DISABLE_MOTOR
+    //kEStopZeroTorque: 发送位置、速度、力矩和增益均为0的CONTROL_MOTOR
+
+    //*******************************
+    //EStopMode: cmd sent on e-stop
+    //*******************************
+    //kEStopDisable: send DISABLE_MOTOR
+    //kEStopZeroTorque: send CONTROL_MOTOR with zero position, velocity, torque and gains
+    kEStopDisable = 0,
+    kEStopZeroTorque = 1
+};
+
+enum EStopSource{
+    //*******************************
+    //EStopSource: 急停的触发来源
+    //*******************************
+    //EStopSource: source that triggered the e-stop
+    kEStopManual = (0x01 << 0),
+    kEStopSignal = (0x01 << 1),
+    kEStopWatchdog = (0x01 << 2),
+    kEStopMotorError = (0x01 << 3)
+};
+
+enum EStopStatus{
+    //*******************************
+    //EStopStatus: 急停的状态
+    //*******************************
+    //kEStopIdle: 未触发
+    //kEStopSent: 急停帧已发出，等待应答
+    //kEStopConfirmed: 所有关节均已应答
+    //kEStopUnconfirmed: 重发后仍有关节未应答
+
+    //*******************************
+    //EStopStatus: state of the e-stop
+    //*******************************
+    //kEStopIdle: not triggered
+    //kEStopSent: e-stop frames sent, waiting for replies
+    //kEStopConfirmed: all motors replied
+    //kEStopUnconfirmed: some motors did not reply after resending
+    kEStopIdle = 0,
+    kEStopSent = 1,
+    kEStopConfirmed = 2,
+    kEStopUnconfirmed = 3
+};
+
+//急停使用的一条can总线，持有独立的socket，不与DrMotorCan共用锁
+//One can bus used by the e-stop, owning a separate socket that shares no lock with DrMotorCan
+typedef struct
+{
+    int can_socket_;
+    int motor_num_;
+    uint8_t motor_ids_[ESTOP_MAX_MOTORS];
+    struct can_frame frames_[ESTOP_MAX_MOTORS];
+    bool sent_[ESTOP_MAX_MOTORS];
+    bool acked_[ESTOP_MAX_MOTORS];
+}EStopBus;
+
+//MotorEStop类，预先生成所有关节的急停帧，并在后台线程确认应答和检查看门狗
+//MotorEStop struct, pre-building e-stop frames of all motors, with a background thread confirming replies and checking the watchdog
+typedef struct
+{
+    int mode_;
+    int bus_num_;
+    EStopBus buses_[ESTOP_MAX_BUSES];
+    uint16_t error_mask_;
+    int64_t watchdog_timeout_ns_;
+    int64_t last_kick_ns_;
+
+    int triggered_;
+    int source_;
+    int status_;
+    int resends_;
+    int unsent_;
+    int control_stopped_;
+    int reset_requested_;
+    int64_t trigger_ns_;
+    int64_t sent_ns_;
+
+    uint32_t trigger_count_;
+    int64_t send_latency_ns_;
+    int64_t worst_send_latency_ns_;
+    int64_t ack_latency_ns_;
+    int64_t worst_ack_latency_ns_;
+
+    bool running_;
+    pthread_t thread_;
+}MotorEStop;
+
+//单调时钟的当前时间，单位ns，可在信号处理函数中调用
+//Current time of the monotonic clock in ns, safe to call from a signal handler
+static inline int64_t EStopNowNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//创建MotorEStop实例
+//Create MotorEStop object
+static inline MotorEStop *MotorEStopCreate(int mode){
+    MotorEStop *estop = (MotorEStop*)calloc(1, sizeof(MotorEStop));
+    if(estop != NULL){
+        estop->mode_ = mode;
+        estop->error_mask_ = kOverVoltage | kOverCurrent | kMotorOverTemp | kDriverOverTemp;
+    }
+    return estop;
+}
+
+//为can_name上的motor_num个关节打开急停socket并预先生成急停帧，返回0表示成功。
+//必须在MotorEStopStart()之前调用，后台线程启动后总线列表不再改变，之后调用返回-1
+//Open an e-stop socket on can_name and pre-build e-stop frames for motor_num motors, return 0 on success.
+//Must be called before MotorEStopStart(), the bus list is fixed once the background thread runs and later calls return -1
+static inline int MotorEStopAddBus(MotorEStop *estop, const char *can_name, const uint8_t *motor_ids, int motor_num){
+    if(__atomic_load_n(&estop->running_, __ATOMIC_ACQUIRE)){
+        printf("[ERROR] E-stop buses must be added before MotorEStopStart()\r\n");
+        return -1;
+    }
+    if(estop->bus_num_ >= ESTOP_MAX_BUSES || motor_num <= 0 || motor_num > ESTOP_MAX_MOTORS){
+        printf("[ERROR] Invalid number of buses or motors for e-stop\r\n");
+        return -1;
+    }
+    EStopBus *bus = &estop->buses_[estop->bus_num_];
+
+    if((bus->can_socket_ = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0){
+        printf("[ERROR] E-stop socket creation failed\r\n");
+        return -1;
+    }
+    int flags = fcntl(bus->can_socket_, F_GETFL, 0);
+    if(flags == -1 || fcntl(bus->can_socket_, F_SETFL, flags | O_NONBLOCK) == -1){
+        printf("[ERROR] Setting e-stop socket to non-blocking mode failed\r\n");
+        close(bus->can_socket_);
+        return -1;
+    }
+    //急停帧不回环到本机的其他socket，避免被当作关节应答
+    //E-stop frames are not looped back to other local sockets, so they are not taken as motor replies
+    int loopback = 0;
+    setsockopt(bus->can_socket_, SOL_CAN_RAW, CAN_RAW_LOOPBACK, &loopback, sizeof(loopback));
+
+    struct ifreq ifr;
+    struct sockaddr_can addr;
+    memset(&ifr, 0, sizeof(ifr));
+    memset(&addr, 0, sizeof(addr));
+    strncpy(ifr.ifr_name, can_name, IFNAMSIZ - 1);
+    if(ioctl(bus->can_socket_, SIOCGIFINDEX, &ifr) < 0){
+        printf("[ERROR] E-stop can interface %s not found\r\n", can_name);
+        close(bus->can_socket_);
+        return -1;
+    }
+    addr.can_ifindex = ifr.ifr_ifindex;
+    addr.can_family = AF_CAN;
+    if(bind(bus->can_socket_, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+        printf("[ERROR] E-stop bind failed\r\n");
+        close(bus->can_socket_);
+        return -1;
+    }
+
+    MotorCMD cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    bus->motor_num_ = motor_num;
+    for(int i = 0; i < motor_num; i++){
+        bus->motor_ids_[i] = motor_ids[i];
+        if(estop->mode_ == kEStopZeroTorque){
+            SetMotionCMD(&cmd, motor_ids[i], CONTROL_MOTOR, 0, 0, 0, 0, 0);
+        }
+        else{
+            SetNormalCMD(&cmd, motor_ids[i], DISABLE_MOTOR);
+        }
+        memset(&bus->frames_[i], 0, sizeof(bus->frames_[i]));
+        MakeSendFrame(&cmd, &bus->frames_[i]);
+    }
+    estop->bus_num_++;
+    return 0;
+}
+
+//设置看门狗超时，单位ms，0为关闭。开启后需周期调用MotorEStopKick()
+//Set the watchdog timeout in ms, 0 disables it. Once enabled, MotorEStopKick() must be called periodically
+static inline void MotorEStopSetWatchdog(MotorEStop *estop, int timeout_ms){
+    __atomic_store_n(&estop->last_kick_ns_, EStopNowNs(), __ATOMIC_RELEASE);
+    __atomic_store_n(&estop->watchdog_timeout_ns_, (int64_t)timeout_ms * 1000000LL, __ATOMIC_RELEASE);
+}
+
+//喂狗，通常在每个控制周期调用
+//Kick the watchdog, usually once per control cycle
+static inline void MotorEStopKick(MotorEStop *estop){
+    __atomic_store_n(&estop->last_kick_ns_, EStopNowNs(), __ATOMIC_RELEASE);
+}
+
+//设置触发急停的MotorErrorType位
+//Set the MotorErrorType bits that trigger the e-stop
+static inline void MotorEStopSetErrorMask(MotorEStop *estop, uint16_t error_mask){
+    estop->error_mask_ = error_mask;
+}
+
+//写出第i个关节的急停帧，记录是否进入发送队列，返回是否成功
+//Write the e-stop frame of the i-th motor and record whether it was queued, return whether it succeeded
+static inline bool EStopSendBus(EStopBus *bus, int i){
+    ssize_t nbytes = write(bus->can_socket_, &bus->frames_[i], sizeof(bus->frames_[i]));
+    bus->sent_[i] = nbytes == sizeof(bus->frames_[i]);
+    return bus->sent_[i];
+}
+
+//记录发送延迟，即从触发到最后一帧急停帧进入发送队列的时间
+//Record the send latency, i.e. the time from the trigger until the last e-stop frame was queued
+static inline void EStopRecordSendLatency(MotorEStop *estop, int64_t sent_ns){
+    int64_t latency = sent_ns - __atomic_load_n(&estop->trigger_ns_, __ATOMIC_RELAXED);
+    __atomic_store_n(&estop->send_latency_ns_, latency, __ATOMIC_RELAXED);
+    if(latency > __atomic_load_n(&estop->worst_send_latency_ns_, __ATOMIC_RELAXED)){
+        __atomic_store_n(&estop->worst_send_latency_ns_, latency, __ATOMIC_RELAXED);
+    }
+}
+
+//触发急停，将预先生成的急停帧同时发往所有总线。只使用原子操作、clock_gettime()和write()，
+//可在信号处理函数中调用，重复触发时直接返回。发送队列满而未写出的帧由后台线程立即重试，
+//此时发送延迟在最后一帧写出后才记录
+//Trigger the e-stop, sending the pre-built frames on all buses at once. Only atomics, clock_gettime() and write() are used,
+//so it can be called from a signal handler, repeated triggers return immediately. Frames not written because the send
+//queue is full are retried right away by the background thread, and the send latency is recorded once the last one is out
+static inline void MotorEStopTrigger(MotorEStop *estop, int source){
+    int expected = 0;
+    if(!__atomic_compare_exchange_n(&estop->triggered_, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        return;
+    }
+    int saved_errno = errno;
+    int64_t trigger_ns = EStopNowNs();
+    __atomic_store_n(&estop->trigger_ns_, trigger_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&estop->source_, source, __ATOMIC_RELAXED);
+
+    //依次取各总线上的第i个关节，使每条总线尽早发出第一帧
+    //Take the i-th motor of every bus in turn, so each bus puts out its first frame as early as possible
+    int unsent = 0;
+    for(int i = 0; i < ESTOP_MAX_MOTORS; i++){
+        bool any = false;
+        for(int b = 0; b < estop->bus_num_; b++){
+            if(i < estop->buses_[b].motor_num_){
+                if(!EStopSendBus(&estop->buses_[b], i)){
+                    unsent++;
+                }
+                any = true;
+            }
+        }
+        if(!any){
+            break;
+        }
+    }
+
+    int64_t sent_ns = EStopNowNs();
+    __atomic_store_n(&estop->sent_ns_, sent_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&estop->unsent_, unsent, __ATOMIC_RELAXED);
+    if(unsent == 0){
+        EStopRecordSendLatency(estop, sent_ns);
+    }
+    __atomic_add_fetch(&estop->trigger_count_, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&estop->status_, kEStopSent, __ATOMIC_RELEASE);
+    errno = saved_errno;
+}
+
+//关节状态字中出现error_mask_中的位时触发急停，返回是否触发
+//Trigger the e-stop when the motor status word has a bit of error_mask_, return whether it triggered
+static inline bool MotorEStopCheckError(MotorEStop *estop, uint16_t error){
+    if(error & estop->error_mask_){
+        MotorEStopTrigger(estop, kEStopMotorError);
+        return true;
+    }
+    return false;
+}
+
+//通知控制线程已停止发送控制命令，应在触发后控制线程最后一次SendRecv()返回之后调用。
+//kEStopZeroTorque模式下关节对急停帧和普通控制命令的应答无法区分，因此在此之前不确认应答，
+//调用后重发所有急停帧，只以之后的应答确认；kEStopDisable模式下无影响
+//Tell that the control threads stopped sending control cmds, to be called after their last SendRecv() following the trigger
+//returned. In kEStopZeroTorque mode the replies to e-stop frames cannot be told apart from replies to ordinary control cmds,
+//so no reply is accepted before this call; afterwards all e-stop frames are resent and only later replies confirm.
+//No effect in kEStopDisable mode
+static inline void MotorEStopControlStopped(MotorEStop *estop){
+    __atomic_store_n(&estop->control_stopped_, 1, __ATOMIC_RELEASE);
+}
+
+//急停是否已被触发，控制线程应在触发后停止发送控制命令
+//Whether the e-stop has been triggered, control threads should stop sending control cmds afterwards
+static inline bool MotorEStopIsTriggered(const MotorEStop *estop){
+    return __atomic_load_n(&estop->triggered_, __ATOMIC_ACQUIRE) != 0;
+}
+
+//急停的状态，见EStopStatus
+//State of the e-stop, see EStopStatus
+static inline int MotorEStopStatus(const MotorEStop *estop){
+    return __atomic_load_n(&estop->status_, __ATOMIC_ACQUIRE);
+}
+
+//读取急停socket上的帧，记录关节应答；本机发出的帧被忽略
+//Read frames on the e-stop socket and record motor replies; frames sent from this host are ignored
+static inline void EStopDrainBus(MotorEStop *estop, EStopBus *bus, bool record){
+    uint32_t ack_cmd = estop->mode_ == kEStopZeroTorque ? CONTROL_MOTOR : DISABLE_MOTOR;
+    while(true){
+        struct can_frame frame;
+        struct iovec iov;
+        struct msghdr msg;
+        iov.iov_base = &frame;
+        iov.iov_len = sizeof(frame);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        ssize_t nbytes = recvmsg(bus->can_socket_, &msg, 0);
+        if(nbytes != sizeof(frame)){
+            return;
+        }
+        if(!record || (msg.msg_flags & MSG_DONTROUTE) || (frame.can_id & CAN_ERR_FLAG)){
+            continue;
+        }
+        uint32_t cmd = (frame.can_id >> CAN_ID_SHIFT_BITS) & 0x3f;
+        uint32_t motor_id = frame.can_id & 0x0f;
+        if(cmd != ack_cmd){
+            continue;
+        }
+        for(int i = 0; i < bus->motor_num_; i++){
+            if(bus->motor_ids_[i] == motor_id){
+                bus->acked_[i] = true;
+                break;
+            }
+        }
+    }
+}
+
+//所有关节均已应答时返回true，没有登记任何关节时返回false
+//Return true when every motor replied, false when no motor is registered
+static inline bool EStopAllAcked(const MotorEStop *estop){
+    int motor_num = 0;
+    for(int b = 0; b < estop->bus_num_; b++){
+        const EStopBus *bus = &estop->buses_[b];
+        for(int i = 0; i < bus->motor_num_; i++){
+            if(!bus->acked_[i]){
+                return false;
+            }
+        }
+        motor_num += bus->motor_num_;
+    }
+    return motor_num > 0;
+}
+
+//清除触发状态、发送和应答记录，由后台线程或在其未运行时调用
+//Clear the trigger state and the sent and replied records, called by the background thread or while it is not running
+static inline void EStopClear(MotorEStop *estop){
+    for(int b = 0; b < estop->bus_num_; b++){
+        memset(estop->buses_[b].sent_, 0, sizeof(estop->buses_[b].sent_));
+        memset(estop->buses_[b].acked_, 0, sizeof(estop->buses_[b].acked_));
+    }
+    estop->resends_ = 0;
+    __atomic_store_n(&estop->unsent_, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&estop->control_stopped_, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&estop->status_, kEStopIdle, __ATOMIC_RELEASE);
+    MotorEStopKick(estop);
+    __atomic_store_n(&estop->triggered_, 0, __ATOMIC_RELEASE);
+}
+
+//重试未写出的急停帧。触发时有帧未写出的，全部写出后记录发送延迟
+//Retry e-stop frames that were not written. If some were left unsent by the trigger, the send latency is recorded once all are out
+static inline void EStopRetryUnsent(MotorEStop *estop, int bus_num){
+    bool was_unsent = __atomic_load_n(&estop->unsent_, __ATOMIC_RELAXED) > 0;
+    int unsent = 0;
+    for(int b = 0; b < bus_num; b++){
+        EStopBus *bus = &estop->buses_[b];
+        for(int i = 0; i < bus->motor_num_; i++){
+            if(!bus->sent_[i] && !EStopSendBus(bus, i)){
+                unsent++;
+            }
+        }
+    }
+    __atomic_store_n(&estop->unsent_, unsent, __ATOMIC_RELAXED);
+    if(was_unsent && unsent == 0){
+        EStopRecordSendLatency(estop, EStopNowNs());
+    }
+}
+
+//后台线程: 检查看门狗，确认急停应答，并向未应答的关节重发
+//Background thread: check the watchdog, confirm e-stop replies and resend to motors that have not replied
+static inline void *MotorEStopThreadFunc(void *args){
+    MotorEStop *estop = (MotorEStop *)args;
+    int bus_num = estop->bus_num_;
+    struct pollfd pfds[ESTOP_MAX_BUSES];
+    for(int b = 0; b < bus_num; b++){
+        pfds[b].fd = estop->buses_[b].can_socket_;
+        pfds[b].events = POLLIN;
+    }
+    int64_t last_send_ns = 0;
+    //kEStopZeroTorque模式下，控制线程停止后是否已重发急停帧
+    //In kEStopZeroTorque mode, whether the e-stop frames were resent after the control threads stopped
+    bool zero_torque_armed = false;
+    while(__atomic_load_n(&estop->running_, __ATOMIC_ACQUIRE)){
+        if(__atomic_load_n(&estop->reset_requested_, __ATOMIC_ACQUIRE)){
+            EStopClear(estop);
+            last_send_ns = 0;
+            zero_torque_armed = false;
+            __atomic_store_n(&estop->reset_requested_, 0, __ATOMIC_RELEASE);
+            continue;
+        }
+        int64_t now = EStopNowNs();
+        if(!MotorEStopIsTriggered(estop)){
+            int64_t timeout = __atomic_load_n(&estop->watchdog_timeout_ns_, __ATOMIC_ACQUIRE);
+            if(timeout > 0 && now - __atomic_load_n(&estop->last_kick_ns_, __ATOMIC_ACQUIRE) > timeout){
+                MotorEStopTrigger(estop, kEStopWatchdog);
+            }
+        }
+
+        poll(pfds, bus_num, 1);
+        //poll期间可能已被触发，在poll之后读取状态，避免丢弃触发后到达的应答
+        //The e-stop may have been triggered during poll, so the state is read after it to keep replies arriving after the trigger
+        bool sent = MotorEStopStatus(estop) == kEStopSent;
+        bool record = sent && (estop->mode_ != kEStopZeroTorque || zero_torque_armed);
+        for(int b = 0; b < bus_num; b++){
+            EStopDrainBus(estop, &estop->buses_[b], record);
+        }
+        if(!sent){
+            continue;
+        }
+
+        now = EStopNowNs();
+        if(estop->mode_ == kEStopZeroTorque && !zero_torque_armed){
+            if(!__atomic_load_n(&estop->control_stopped_, __ATOMIC_ACQUIRE)){
+                continue;
+            }
+            //控制线程已停止，此后的CONTROL_MOTOR应答只能来自急停帧: 清除应答记录并重发所有急停帧
+            //The control threads stopped, so later CONTROL_MOTOR replies can only answer e-stop frames: clear the
+            //replies and resend all e-stop frames
+            for(int b = 0; b < bus_num; b++){
+                EStopBus *bus = &estop->buses_[b];
+                memset(bus->acked_, 0, sizeof(bus->acked_));
+                memset(bus->sent_, 0, sizeof(bus->sent_));
+            }
+            EStopRetryUnsent(estop, bus_num);
+            estop->resends_ = 0;
+            last_send_ns = now;
+            zero_torque_armed = true;
+            continue;
+        }
+        if(__atomic_load_n(&estop->unsent_, __ATOMIC_RELAXED) > 0){
+            EStopRetryUnsent(estop, bus_num);
+        }
+
+        int64_t sent_ns = __atomic_load_n(&estop->sent_ns_, __ATOMIC_RELAXED);
+        if(last_send_ns < sent_ns){
+            last_send_ns = sent_ns;
+        }
+        if(EStopAllAcked(estop)){
+            int64_t latency = now - __atomic_load_n(&estop->trigger_ns_, __ATOMIC_RELAXED);
+            estop->ack_latency_ns_ = latency;
+            if(latency > estop->worst_ack_latency_ns_){
+                estop->worst_ack_latency_ns_ = latency;
+            }
+            __atomic_store_n(&estop->status_, kEStopConfirmed, __ATOMIC_RELEASE);
+        }
+        else if(now - last_send_ns > ESTOP_RESEND_MS * 1000000LL){
+            if(estop->resends_ >= ESTOP_MAX_RESENDS){
+                __atomic_store_n(&estop->status_, kEStopUnconfirmed, __ATOMIC_RELEASE);
+                continue;
+            }
+            for(int b = 0; b < bus_num; b++){
+                EStopBus *bus = &estop->buses_[b];
+                for(int i = 0; i < bus->motor_num_; i++){
+                    if(bus->sent_[i] && !bus->acked_[i]){
+                        EStopSendBus(bus, i);
+                    }
+                }
+            }
+            estop->resends_++;
+            last_send_ns = now;
+        }
+    }
+    return NULL;
+}
+
+//启动后台线程，返回0表示成功。没有登记任何总线或已启动时返回-1
+//Start the background thread, return 0 on success. Return -1 when no bus is registered or the thread already runs
+static inline int MotorEStopStart(MotorEStop *estop){
+    if(estop->bus_num_ == 0){
+        printf("[ERROR] No bus added to e-stop\r\n");
+        return -1;
+    }
+    if(__atomic_load_n(&estop->running_, __ATOMIC_ACQUIRE)){
+        printf("[ERROR] E-stop thread already started\r\n");
+        return -1;
+    }
+    __atomic_store_n(&estop->running_, true, __ATOMIC_RELEASE);
+    if(pthread_create(&estop->thread_, NULL, MotorEStopThreadFunc, (void*)estop) != 0){
+        __atomic_store_n(&estop->running_, false, __ATOMIC_RELEASE);
+        printf("[ERROR] Creating e-stop thread failed\r\n");
+        return -1;
+    }
+    return 0;
+}
+
+//等待急停被确认，超时、未确认或后台线程未运行时返回false
+//Wait for the e-stop to be confirmed, return false on timeout, when unconfirmed or when the background thread is not running
+static inline bool MotorEStopWaitConfirmed(const MotorEStop *estop, int timeout_ms){
+    if(!__atomic_load_n(&estop->running_, __ATOMIC_ACQUIRE)){
+        return false;
+    }
+    int64_t deadline = EStopNowNs() + (int64_t)timeout_ms * 1000000LL;
+    while(EStopNowNs() < deadline){
+        int status = MotorEStopStatus(estop);
+        if(status == kEStopConfirmed){
+            return true;
+        }
+        if(status == kEStopUnconfirmed){
+            return false;
+        }
+        usleep(100);
+    }
+    return false;
+}
+
+//重新布防，清除触发状态和应答记录，保留最坏延迟统计。后台线程运行时由其执行并等待完成，不可在信号处理函数中调用
+//Re-arm, clearing the trigger state and replies while keeping the worst-case latency statistics. While the background
+//thread runs, the reset is handed to it and this call waits for it to finish, not to be called from a signal handler
+static inline void MotorEStopReset(MotorEStop *estop){
+    if(!__atomic_load_n(&estop->running_, __ATOMIC_ACQUIRE)){
+        EStopClear(estop);
+        return;
+    }
+    __atomic_store_n(&estop->reset_requested_, 1, __ATOMIC_RELEASE);
+    while(__atomic_load_n(&estop->reset_requested_, __ATOMIC_ACQUIRE)){
+        usleep(100);
+    }
+}
+
+//打印急停的延迟统计
+//Print latency statistics of the e-stop
+static inline void PrintMotorEStopLatency(const MotorEStop *estop){
+    printf("[INFO] E-stop source: %d, status: %d, triggers: %u, send latency: %lld us (worst %lld us), "
+           "ack latency: %lld us (worst %lld us)\r\n",
+        estop->source_, MotorEStopStatus(estop), estop->trigger_count_,
+        (long long)(estop->send_latency_ns_ / 1000), (long long)(estop->worst_send_latency_ns_ / 1000),
+        (long long)(estop->ack_latency_ns_ / 1000), (long long)(estop->worst_ack_latency_ns_ / 1000));
+}
+
+//停止后台线程并销毁MotorEStop实例
+//Stop the background thread and destroy MotorEStop object
+static inline void MotorEStopDestroy(MotorEStop *estop){
+    if(__atomic_load_n(&estop->running_, __ATOMIC_ACQUIRE)){
+        __atomic_store_n(&estop->running_, false, __ATOMIC_RELEASE);
+        pthread_join(estop->thread_, NULL);
+    }
+    for(int b = 0; b < estop->bus_num_; b++){
+        close(estop->buses_[b].can_socket_);
+    }
+    free(estop);
+}
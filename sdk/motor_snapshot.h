@@ -0,0 +1,80 @@
+#pragma once
+
+#include "deep_motor_sdk.h"
+
+//整机状态快照中各关节采样时间的信息。stale_mask_的第i位表示第i个关节的采样过期或从未收到应答，
+//仅记录前64个关节，stale_num_统计全部关节
+//Sample time information of the joints in a whole-body snapshot. Bit i of stale_mask_ marks the i-th motor as stale
+//or never replied, only the first 64 motors are recorded there while stale_num_ counts all of them
+typedef struct
+{
+    int motor_num_;
+    double oldest_stamp_;
+    double newest_stamp_;
+    double skew_;
+    double ref_stamp_;
+    bool extrapolated_;
+    int stale_num_;
+    uint64_t stale_mask_;
+}MotorSnapshotInfo;
+
+static inline bool MotorSnapshotIsStale(const MotorDATA *data, double now, double max_age){
+    return data->stamp_ <= 0 || (max_age > 0 && now - data->stamp_ > max_age);
+}
+
+//将num个关节的状态复制为一个快照，并计算各采样之间的时间差。
+//ref_stamp <= 0时参考时间取最新的采样时间。extrapolate为true时，按各关节的速度将位置外推到参考时间，
+//stamp_也改为参考时间。stamp_为0(未收到过应答)或早于当前时间max_age秒以上的关节记为过期，
+//不参与外推和时间差计算，max_age <= 0时不检查采样时长
+//Copy the states of num motors into one snapshot and compute the skew between the samples.
+//With ref_stamp <= 0 the reference time is the newest sample. With extrapolate set, the position of each motor is
+//extrapolated to the reference time with its velocity and stamp_ becomes the reference time. Motors whose stamp_
+//is 0 (no reply received yet) or older than max_age seconds are marked stale and left out of extrapolation and skew,
+//max_age <= 0 disables the age check
+static inline void MotorSnapshotTake(const MotorDATA *data, int num, double ref_stamp, double max_age, bool extrapolate,
+                                     MotorDATA *snapshot, MotorSnapshotInfo *info){
+    double now = MotorClockNow();
+    double oldest = 0, newest = 0;
+    int stale_num = 0;
+    uint64_t stale_mask = 0;
+    for(int i = 0; i < num; i++){
+        snapshot[i] = data[i];
+        double stamp = data[i].stamp_;
+        if(MotorSnapshotIsStale(&data[i], now, max_age)){
+            stale_num++;
+            if(i < 64){
+                stale_mask |= 1ULL << i;
+            }
+            continue;
+        }
+        if(oldest <= 0 || stamp < oldest){
+            oldest = stamp;
+        }
+        if(stamp > newest){
+            newest = stamp;
+        }
+    }
+    if(ref_stamp <= 0){
+        ref_stamp = newest;
+    }
+
+    if(extrapolate){
+        for(int i = 0; i < num; i++){
+            if(MotorSnapshotIsStale(&data[i], now, max_age)){
+                continue;
+            }
+            float dt = (float)(ref_stamp - snapshot[i].stamp_);
+            snapshot[i].position_ += snapshot[i].velocity_ * dt;
+            snapshot[i].stamp_ = ref_stamp;
+        }
+    }
+
+    info->motor_num_ = num;
+    info->oldest_stamp_ = oldest;
+    info->newest_stamp_ = newest;
+    info->skew_ = newest - oldest;
+    info->ref_stamp_ = ref_stamp;
+    info->extrapolated_ = extrapolate;
+    info->stale_num_ = stale_num;
+    info->stale_mask_ = stale_mask;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <math.h>
+
+#include "deep_motor_sdk.h"
+
+//温度变化率的默认统计窗口，单位秒
+//Default window for the temperature rate of change, in seconds
+#define TELEMETRY_RATE_WINDOW 5.0f
+
+//单个遥测量的滚动统计
+//Rolling statistics of one telemetry value
+typedef struct
+{
+    bool valid_;
+    float value_;
+    float ewma_;
+    float min_;
+    float max_;
+    float rate_;
+    double stamp_;
+    float slow_;
+    float window_value_;
+    double window_stamp_;
+}TelemetryStat;
+
+enum TelemetryAlarmType{
+    //*******************************
+    //TelemetryAlarmType: 遥测报警类型
+    //*******************************
+    //kMotorTempAlarm: 关节温度预计到达阈值
+    //kDriverTempAlarm: 驱动板温度预计到达阈值
+
+    //*******************************
+    //TelemetryAlarmType: type of telemetry alarm
+    //*******************************
+    //kMotorTempAlarm: motor temperature is predicted to reach the threshold
+    //kDriverTempAlarm: driver board temperature is predicted to reach the threshold
+    kMotorTempAlarm = 0,
+    kDriverTempAlarm = 1
+};
+
+//报警回调，value为触发报警时的预测温度
+//Alarm callback, value is the predicted temperature when the alarm fires
+typedef void (*TelemetryAlarmFunc)(uint8_t motor_id, int alarm, float value, void *user);
+
+//存储单个关节的遥测数据，由CONTROL_MOTOR应答增量更新
+//Struct saving telemetry of one motor, updated incrementally from CONTROL_MOTOR replies
+typedef struct
+{
+    uint8_t motor_id_;
+    float alpha_;
+    float rate_window_;
+    TelemetryStat motor_temp_;
+    TelemetryStat driver_temp_;
+    float torque_sq_ewma_;
+    float torque_rms_;
+    uint32_t samples_;
+
+    float motor_temp_threshold_;
+    float driver_temp_threshold_;
+    float hysteresis_;
+    float lead_time_;
+    bool motor_temp_alarm_;
+    bool driver_temp_alarm_;
+    TelemetryAlarmFunc alarm_func_;
+    void *alarm_user_;
+}MotorTelemetry;
+
+//初始化MotorTelemetry，alpha为EWMA的平滑系数(0, 1]
+//Initialize MotorTelemetry, alpha is the EWMA smoothing factor in (0, 1]
+static inline void MotorTelemetryInit(MotorTelemetry *telemetry, uint8_t motor_id, float alpha){
+    memset(telemetry, 0, sizeof(MotorTelemetry));
+    telemetry->motor_id_ = motor_id;
+    telemetry->alpha_ = alpha;
+    telemetry->rate_window_ = TELEMETRY_RATE_WINDOW;
+    telemetry->motor_temp_threshold_ = MOTOR_TEMP_MAX;
+    telemetry->driver_temp_threshold_ = DRIVER_TEMP_MAX;
+}
+
+//设置温度变化率的统计窗口，单位秒。变化率由时间常数为window的慢速滤波在每个窗口内的变化得到，与alpha无关
+//Set the window for the temperature rate of change, in seconds. The rate is the change per window of a slow
+//filter with time constant window, independent of alpha
+static inline void MotorTelemetrySetRateWindow(MotorTelemetry *telemetry, float window){
+    telemetry->rate_window_ = window;
+}
+
+//设置温度报警阈值。当EWMA温度加上lead_time秒内的预计温升达到阈值时触发回调，
+//温度回落到阈值减hysteresis以下后才会再次触发。阈值应低于固件的过温保护值
+//Set the temperature alarm thresholds. The callback fires when the EWMA temperature plus the rise
+//expected within lead_time seconds reaches the threshold, and re-arms once it drops below
+//threshold minus hysteresis. Thresholds should be set below the firmware over temp limits
+static inline void MotorTelemetrySetAlarm(MotorTelemetry *telemetry, float motor_temp_threshold, float driver_temp_threshold,
+                                          float hysteresis, float lead_time, TelemetryAlarmFunc func, void *user){
+    telemetry->motor_temp_threshold_ = motor_temp_threshold;
+    telemetry->driver_temp_threshold_ = driver_temp_threshold;
+    telemetry->hysteresis_ = hysteresis;
+    telemetry->lead_time_ = lead_time;
+    telemetry->alarm_func_ = func;
+    telemetry->alarm_user_ = user;
+}
+
+static inline void TelemetryStatUpdate(TelemetryStat *stat, float value, float alpha, float window, double stamp){
+    if(!stat->valid_){
+        stat->valid_ = true;
+        stat->value_ = value;
+        stat->ewma_ = value;
+        stat->min_ = value;
+        stat->max_ = value;
+        stat->rate_ = 0;
+        stat->stamp_ = stamp;
+        stat->slow_ = value;
+        stat->window_value_ = value;
+        stat->window_stamp_ = stamp;
+        return;
+    }
+    //慢速滤波按时间而非样本数计算系数，与采样频率无关
+    //The slow filter weights by elapsed time rather than sample count, so it does not depend on the sample rate
+    double dt = stamp - stat->stamp_;
+    if(dt > 0){
+        stat->slow_ += (float)(dt / (window + dt)) * (value - stat->slow_);
+    }
+    double window_dt = stamp - stat->window_stamp_;
+    if(window_dt >= window){
+        stat->rate_ = (float)((stat->slow_ - stat->window_value_) / window_dt);
+        stat->window_value_ = stat->slow_;
+        stat->window_stamp_ = stamp;
+    }
+    stat->value_ = value;
+    stat->ewma_ += alpha * (value - stat->ewma_);
+    stat->stamp_ = stamp;
+    if(value < stat->min_){
+        stat->min_ = value;
+    }
+    if(value > stat->max_){
+        stat->max_ = value;
+    }
+}
+
+static inline void TelemetryCheckAlarm(MotorTelemetry *telemetry, const TelemetryStat *stat, float threshold, bool *alarm, int type){
+    float predicted = stat->ewma_;
+    if(stat->rate_ > 0){
+        predicted += stat->rate_ * telemetry->lead_time_;
+    }
+    if(!*alarm && predicted >= threshold){
+        *alarm = true;
+        if(telemetry->alarm_func_ != NULL){
+            telemetry->alarm_func_(telemetry->motor_id_, type, predicted, telemetry->alarm_user_);
+        }
+    }
+    else if(*alarm && predicted < threshold - telemetry->hysteresis_){
+        *alarm = false;
+    }
+}
+
+//用一帧CONTROL_MOTOR应答更新遥测，stamp为接收时间(秒)，其他命令的应答被忽略
+//Update telemetry with one CONTROL_MOTOR reply, stamp is the receive time in seconds, replies of other cmds are ignored
+static inline void MotorTelemetryUpdate(MotorTelemetry *telemetry, const MotorDATA *data, double stamp){
+    if(data->cmd_ != CONTROL_MOTOR || data->motor_id_ != telemetry->motor_id_){
+        return;
+    }
+    float alpha = telemetry->alpha_;
+    float window = telemetry->rate_window_;
+    if(data->flag_ == kMotorTempFlag){
+        TelemetryStatUpdate(&telemetry->motor_temp_, data->motor_temp_, alpha, window, stamp);
+        TelemetryCheckAlarm(telemetry, &telemetry->motor_temp_, telemetry->motor_temp_threshold_,
+                            &telemetry->motor_temp_alarm_, kMotorTempAlarm);
+    }
+    else{
+        TelemetryStatUpdate(&telemetry->driver_temp_, data->driver_temp_, alpha, window, stamp);
+        TelemetryCheckAlarm(telemetry, &telemetry->driver_temp_, telemetry->driver_temp_threshold_,
+                            &telemetry->driver_temp_alarm_, kDriverTempAlarm);
+    }
+
+    float torque_sq = data->torque_ * data->torque_;
+    if(telemetry->samples_ == 0){
+        telemetry->torque_sq_ewma_ = torque_sq;
+    }
+    else{
+        telemetry->torque_sq_ewma_ += alpha * (torque_sq - telemetry->torque_sq_ewma_);
+    }
+    telemetry->torque_rms_ = sqrtf(telemetry->torque_sq_ewma_);
+    telemetry->samples_++;
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+//收发路径的分阶段计时和USDT探针，仅在定义DEEP_MOTOR_TRACE时编译，否则所有宏为空。
+//同一程序中所有包含SDK的源文件必须使用相同的DEEP_MOTOR_TRACE设置
+//Per-phase timing and USDT probes of the send/receive path, compiled only when DEEP_MOTOR_TRACE is defined, otherwise all macros are empty.
+//All source files of one program including the SDK must use the same DEEP_MOTOR_TRACE setting
+
+enum TracePhase{
+    //*******************************
+    //TracePhase: 收发路径的各阶段
+    //*******************************
+    //kTraceEncode: MakeSendFrame()/FloatsToUints()组包
+    //kTraceLockWait: 等待rw_mutex
+    //kTraceWrite: write()
+    //kTraceEpollWait: epoll_wait()等待应答
+    //kTraceRead: recvmsg()
+    //kTraceDecode: ParseRecvFrame()解析
+    //kTraceTotal: 一次SendRecv()/SendRecvBurst()的总时间
+
+    //*******************************
+    //TracePhase: phases of the send/receive path
+    //*******************************
+    //kTraceEncode: frame building in MakeSendFrame()/FloatsToUints()
+    //kTraceLockWait: waiting for rw_mutex
+    //kTraceWrite: write()
+    //kTraceEpollWait: epoll_wait() for replies
+    //kTraceRead: recvmsg()
+    //kTraceDecode: parsing in ParseRecvFrame()
+    //kTraceTotal: whole SendRecv()/SendRecvBurst() call
+    kTraceEncode = 0,
+    kTraceLockWait = 1,
+    kTraceWrite = 2,
+    kTraceEpollWait = 3,
+    kTraceRead = 4,
+    kTraceDecode = 5,
+    kTraceTotal = 6,
+    kTracePhaseNum = 7
+};
+
+#ifdef DEEP_MOTOR_TRACE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define DEEP_MOTOR_USDT 1
+#endif
+#endif
+
+//直方图桶的数量，第k个桶统计[2^k, 2^(k+1))个tick的样本
+//Number of histogram buckets, the k-th bucket counts samples in [2^k, 2^(k+1)) ticks
+#define TRACE_HIST_BUCKETS 40
+
+//单个阶段的计时统计，单位为tick
+//Timing statistics of one phase, in ticks
+typedef struct
+{
+    uint64_t count_;
+    uint64_t total_;
+    uint64_t max_;
+    uint64_t hist_[TRACE_HIST_BUCKETS];
+}TracePhaseStat;
+
+//一条can总线上各阶段的计时统计
+//Timing statistics of all phases on one can bus
+typedef struct
+{
+    TracePhaseStat phases_[kTracePhaseNum];
+}MotorTrace;
+
+//读取周期计数器: x86为TSC，aarch64为cntvct_el0，其他平台为单调时钟的ns
+//Read the cycle counter: TSC on x86, cntvct_el0 on aarch64, monotonic clock ns elsewhere
+static inline uint64_t TraceTicks(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+//每微秒的tick数，首次调用时用单调时钟标定约10ms
+//Ticks per microsecond, calibrated against the monotonic clock for about 10 ms on the first call
+static inline double TraceTicksPerUs(){
+    static double ticks_per_us = 0;
+    if(ticks_per_us == 0){
+        struct timespec ts0, ts1, delay;
+        delay.tv_sec = 0;
+        delay.tv_nsec = 10000000;
+        clock_gettime(CLOCK_MONOTONIC, &ts0);
+        uint64_t t0 = TraceTicks();
+        nanosleep(&delay, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &ts1);
+        uint64_t t1 = TraceTicks();
+        double us = (ts1.tv_sec - ts0.tv_sec) * 1e6 + (ts1.tv_nsec - ts0.tv_nsec) * 1e-3;
+        ticks_per_us = (double)(t1 - t0) / us;
+    }
+    return ticks_per_us;
+}
+
+//记录一个阶段的耗时，可在多个线程中并发调用
+//Record the duration of one phase, may be called from several threads concurrently
+static inline void TraceRecord(MotorTrace *trace, int phase, uint64_t ticks){
+    TracePhaseStat *stat = &trace->phases_[phase];
+    __atomic_add_fetch(&stat->count_, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat->total_, ticks, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&stat->max_, __ATOMIC_RELAXED);
+    while(ticks > max && !__atomic_compare_exchange_n(&stat->max_, &max, ticks, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    }
+    int bucket = ticks == 0 ? 0 : 63 - __builtin_clzll(ticks);
+    if(bucket >= TRACE_HIST_BUCKETS){
+        bucket = TRACE_HIST_BUCKETS - 1;
+    }
+    __atomic_add_fetch(&stat->hist_[bucket], 1, __ATOMIC_RELAXED);
+}
+
+//直方图中第q分位(0~1)所在桶的上界，单位tick
+//Upper bound in ticks of the histogram bucket holding quantile q (0 to 1)
+static inline uint64_t TracePercentile(const TracePhaseStat *stat, double q){
+    uint64_t target = (uint64_t)(q * (double)stat->count_);
+    uint64_t seen = 0;
+    for(int k = 0; k < TRACE_HIST_BUCKETS; k++){
+        seen += stat->hist_[k];
+        if(seen > target){
+            uint64_t upper = 2ULL << k;
+            return upper < stat->max_ ? upper : stat->max_;
+        }
+    }
+    return stat->max_;
+}
+
+static inline const char *TracePhaseName(int phase){
+    switch (phase)
+    {
+    case kTraceEncode:
+        return "encode";
+    case kTraceLockWait:
+        return "lock_wait";
+    case kTraceWrite:
+        return "write";
+    case kTraceEpollWait:
+        return "epoll_wait";
+    case kTraceRead:
+        return "read";
+    case kTraceDecode:
+        return "decode";
+    case kTraceTotal:
+        return "total";
+    default:
+        return "unknown";
+    }
+}
+
+//打印各阶段的耗时分布，单位us，p50/p99为直方图桶的上界
+//Print the time distribution of every phase in us, p50/p99 are upper bounds of histogram buckets
+static inline void PrintMotorTrace(const MotorTrace *trace){
+    double ticks_per_us = TraceTicksPerUs();
+    uint64_t total = trace->phases_[kTraceTotal].total_;
+    printf("[INFO] %-10s %10s %10s %10s %10s %10s %8s\r\n", "phase", "count", "mean_us", "p50_us", "p99_us", "max_us", "share");
+    for(int phase = 0; phase < kTracePhaseNum; phase++){
+        const TracePhaseStat *stat = &trace->phases_[phase];
+        if(stat->count_ == 0){
+            continue;
+        }
+        printf("[INFO] %-10s %10llu %10.2f %10.2f %10.2f %10.2f %7.1f%%\r\n",
+            TracePhaseName(phase), (unsigned long long)stat->count_,
+            (double)stat->total_ / (double)stat->count_ / ticks_per_us,
+            (double)TracePercentile(stat, 0.5) / ticks_per_us,
+            (double)TracePercentile(stat, 0.99) / ticks_per_us,
+            (double)stat->max_ / ticks_per_us,
+            total == 0 ? 0.0 : 100.0 * (double)stat->total_ / (double)total);
+    }
+}
+
+#ifdef DEEP_MOTOR_USDT
+#define TRACE_PROBE_BEGIN(phase) DTRACE_PROBE1(deep_motor, phase_begin, phase)
+#define TRACE_PROBE_END(phase, ticks) DTRACE_PROBE2(deep_motor, phase_end, phase, ticks)
+#else
+#define TRACE_PROBE_BEGIN(phase) ((void)0)
+#define TRACE_PROBE_END(phase, ticks) ((void)0)
+#endif
+
+//开始计时，name为保存起始tick的局部变量
+//Start timing, name is the local variable holding the start tick
+#define TRACE_BEGIN(name, phase) \
+    uint64_t name = TraceTicks(); \
+    TRACE_PROBE_BEGIN(phase)
+
+//结束计时并记录到trace
+//Stop timing and record into trace
+#define TRACE_END(trace, name, phase) \
+    do{ \
+        uint64_t name##_ticks = TraceTicks() - name; \
+        TraceRecord((trace), (phase), name##_ticks); \
+        TRACE_PROBE_END(phase, name##_ticks); \
+    }while(0)
+
+#else
+
+#define TRACE_BEGIN(name, phase)
+#define TRACE_END(trace, name, phase) ((void)0)
+
+#endif
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "deep_motor_sdk.h"
+
+//每个关节路点队列的长度，必须为2的幂
+//Length of the waypoint queue of each motor, must be a power of 2
+#ifndef TRAJECTORY_QUEUE_SIZE
+#define TRAJECTORY_QUEUE_SIZE 64
+#endif
+
+//TrajectoryStream支持的最大关节数量
+//Max number of motors supported by TrajectoryStream
+#ifndef TRAJECTORY_MAX_MOTORS
+#define TRAJECTORY_MAX_MOTORS 12
+#endif
+
+enum TrajectoryType{
+    //*******************************
+    //TrajectoryType: 路点之间的插值方式
+    //*******************************
+    //kTrajectoryCubic: 三次Hermite插值，匹配两端的位置和速度
+    //kTrajectoryQuintic: 五次Hermite插值，匹配两端的位置、速度和加速度
+
+    //*******************************
+    //TrajectoryType: interpolation between waypoints
+    //*******************************
+    //kTrajectoryCubic: cubic Hermite interpolation, matching position and velocity at both ends
+    //kTrajectoryQuintic: quintic Hermite interpolation, matching position, velocity and acceleration at both ends
+    kTrajectoryCubic = 0,
+    kTrajectoryQuintic = 1
+};
+
+enum TrajectoryPointFlag{
+    //*******************************
+    //TrajectoryPointFlag: 路点中由调用者给出的量
+    //*******************************
+    //kTrajectoryVelocityGiven: 使用velocity_，否则由相邻路点估计
+    //kTrajectoryAccelerationGiven: 使用acceleration_，否则由相邻路点估计，仅五次插值使用
+
+    //*******************************
+    //TrajectoryPointFlag: values of a waypoint supplied by the caller
+    //*******************************
+    //kTrajectoryVelocityGiven: use velocity_, otherwise it is estimated from the neighbouring waypoints
+    //kTrajectoryAccelerationGiven: use acceleration_, otherwise it is estimated from the neighbouring waypoints, quintic only
+    kTrajectoryVelocityGiven = (0x01 << 0),
+    kTrajectoryAccelerationGiven = (0x01 << 1)
+};
+
+//路点，time为与TrajectoryEvaluate()相同时钟下的时间(秒)。flags为TrajectoryPointFlag，
+//未给出的速度和加速度由前一个和后一个路点按有限差分估计
+//Waypoint, time is in seconds on the same clock as TrajectoryEvaluate(). flags are TrajectoryPointFlag bits,
+//velocity and acceleration not supplied are estimated by finite differences from the previous and next waypoints
+typedef struct
+{
+    double time_;
+    float position_;
+    float velocity_;
+    float acceleration_;
+    uint8_t flags_;
+}TrajectoryPoint;
+
+//多个关节的轨迹流。规划线程调用TrajectoryPush()，控制线程调用TrajectoryEvaluate()，
+//每个关节的队列为单生产者单消费者无锁队列
+//Trajectory stream of several motors. The planner thread calls TrajectoryPush() and the control thread
+//calls TrajectoryEvaluate(), the queue of each motor is a single-producer single-consumer lock-free queue
+typedef struct
+{
+    int motor_num_;
+    int type_;
+
+    TrajectoryPoint queue_[TRAJECTORY_MAX_MOTORS][TRAJECTORY_QUEUE_SIZE];
+    uint32_t head_[TRAJECTORY_MAX_MOTORS];
+    uint32_t tail_[TRAJECTORY_MAX_MOTORS];
+
+    //当前段的多项式系数，按关节连续存放以便一次遍历所有关节
+    //Polynomial coefficients of the current segment, stored per field so all motors are evaluated in one pass
+    double seg_start_[TRAJECTORY_MAX_MOTORS];
+    float seg_duration_[TRAJECTORY_MAX_MOTORS];
+    float c0_[TRAJECTORY_MAX_MOTORS];
+    float c1_[TRAJECTORY_MAX_MOTORS];
+    float c2_[TRAJECTORY_MAX_MOTORS];
+    float c3_[TRAJECTORY_MAX_MOTORS];
+    float c4_[TRAJECTORY_MAX_MOTORS];
+    float c5_[TRAJECTORY_MAX_MOTORS];
+    TrajectoryPoint seg_end_[TRAJECTORY_MAX_MOTORS];
+
+    bool holding_[TRAJECTORY_MAX_MOTORS];
+    uint32_t underrun_[TRAJECTORY_MAX_MOTORS];
+
+    //TrajectoryEvaluate()的输出
+    //Output of TrajectoryEvaluate()
+    float position_[TRAJECTORY_MAX_MOTORS];
+    float velocity_[TRAJECTORY_MAX_MOTORS];
+}TrajectoryStream;
+
+//创建TrajectoryStream实例，各关节从initial_position开始保持位置
+//Create TrajectoryStream object, every motor starts holding initial_position
+static inline TrajectoryStream *TrajectoryStreamCreate(int motor_num, int type, const float *initial_position, double now){
+    if(motor_num > TRAJECTORY_MAX_MOTORS){
+        printf("[ERROR] TrajectoryStream supports at most %d motors\r\n", TRAJECTORY_MAX_MOTORS);
+        return NULL;
+    }
+    TrajectoryStream *stream = (TrajectoryStream*)calloc(1, sizeof(TrajectoryStream));
+    if(stream != NULL){
+        stream->motor_num_ = motor_num;
+        stream->type_ = type;
+        for(int i = 0; i < motor_num; i++){
+            stream->holding_[i] = true;
+            stream->seg_start_[i] = now;
+            stream->c0_[i] = initial_position[i];
+            stream->position_[i] = initial_position[i];
+            stream->seg_end_[i].time_ = now;
+            stream->seg_end_[i].position_ = initial_position[i];
+        }
+    }
+    return stream;
+}
+
+//销毁TrajectoryStream实例
+//Destroy TrajectoryStream object
+static inline void TrajectoryStreamDestroy(TrajectoryStream *stream){
+    free(stream);
+}
+
+//向第index个关节的队列追加路点，队列满时返回false
+//Append a waypoint to the queue of the index-th motor, return false when the queue is full
+static inline bool TrajectoryPush(TrajectoryStream *stream, int index, const TrajectoryPoint *point){
+    uint32_t tail = __atomic_load_n(&stream->tail_[index], __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&stream->head_[index], __ATOMIC_ACQUIRE);
+    if(tail - head >= TRAJECTORY_QUEUE_SIZE){
+        return false;
+    }
+    stream->queue_[index][tail & (TRAJECTORY_QUEUE_SIZE - 1)] = *point;
+    __atomic_store_n(&stream->tail_[index], tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+//第index个关节队列中剩余的路点数量
+//Number of waypoints left in the queue of the index-th motor
+static inline uint32_t TrajectoryQueued(const TrajectoryStream *stream, int index){
+    return __atomic_load_n(&stream->tail_[index], __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&stream->head_[index], __ATOMIC_ACQUIRE);
+}
+
+static inline bool TrajectoryPop(TrajectoryStream *stream, int index, TrajectoryPoint *point){
+    uint32_t head = __atomic_load_n(&stream->head_[index], __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&stream->tail_[index], __ATOMIC_ACQUIRE);
+    if(head == tail){
+        return false;
+    }
+    *point = stream->queue_[index][head & (TRAJECTORY_QUEUE_SIZE - 1)];
+    __atomic_store_n(&stream->head_[index], head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static inline bool TrajectoryPeek(const TrajectoryStream *stream, int index, TrajectoryPoint *point){
+    uint32_t head = __atomic_load_n(&stream->head_[index], __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&stream->tail_[index], __ATOMIC_ACQUIRE);
+    if(head == tail){
+        return false;
+    }
+    *point = stream->queue_[index][head & (TRAJECTORY_QUEUE_SIZE - 1)];
+    return true;
+}
+
+//估计knot处未给出的速度和加速度: 取过prev、knot、next三点的抛物线在knot处的导数。
+//next为NULL(队列中还没有下一个路点)时视为轨迹终点，速度和加速度为0
+//Estimate velocity and acceleration at knot when they are not supplied, as the derivatives at knot of the parabola
+//through prev, knot and next. With next NULL (no following waypoint queued yet) knot is taken as the end of the
+//trajectory, with zero velocity and acceleration
+static inline void TrajectoryDeriveKnot(const TrajectoryPoint *prev, TrajectoryPoint *knot, const TrajectoryPoint *next){
+    float velocity = 0, acceleration = 0;
+    if(next != NULL){
+        float h0 = (float)(knot->time_ - prev->time_);
+        float h1 = (float)(next->time_ - knot->time_);
+        float d0 = (knot->position_ - prev->position_) / h0;
+        float d1 = (next->position_ - knot->position_) / h1;
+        velocity = (h1 * d0 + h0 * d1) / (h0 + h1);
+        acceleration = 2.0f * (d1 - d0) / (h0 + h1);
+    }
+    if(!(knot->flags_ & kTrajectoryVelocityGiven)){
+        knot->velocity_ = velocity;
+    }
+    if(!(knot->flags_ & kTrajectoryAccelerationGiven)){
+        knot->acceleration_ = acceleration;
+    }
+}
+
+//计算从start到end的多项式系数，三次插值忽略两端加速度
+//Compute polynomial coefficients from start to end, cubic interpolation ignores accelerations at both ends
+static inline void TrajectorySetSegment(TrajectoryStream *stream, int i, const TrajectoryPoint *start, const TrajectoryPoint *end){
+    float T = (float)(end->time_ - start->time_);
+    float h = end->position_ - start->position_;
+    float v0 = start->velocity_, v1 = end->velocity_;
+    stream->seg_start_[i] = start->time_;
+    stream->seg_duration_[i] = T;
+    stream->seg_end_[i] = *end;
+    stream->c0_[i] = start->position_;
+    stream->c1_[i] = v0;
+    if(stream->type_ == kTrajectoryQuintic){
+        float a0 = start->acceleration_, a1 = end->acceleration_;
+        float T2 = T * T, T3 = T2 * T;
+        stream->c2_[i] = 0.5f * a0;
+        stream->c3_[i] = (20.0f * h - (8.0f * v1 + 12.0f * v0) * T - (3.0f * a0 - a1) * T2) / (2.0f * T3);
+        stream->c4_[i] = (-30.0f * h + (14.0f * v1 + 16.0f * v0) * T + (3.0f * a0 - 2.0f * a1) * T2) / (2.0f * T3 * T);
+        stream->c5_[i] = (12.0f * h - 6.0f * (v1 + v0) * T + (a1 - a0) * T2) / (2.0f * T3 * T2);
+    }
+    else{
+        stream->c2_[i] = (3.0f * h / T - 2.0f * v0 - v1) / T;
+        stream->c3_[i] = (-2.0f * h / T + v0 + v1) / (T * T);
+        stream->c4_[i] = 0;
+        stream->c5_[i] = 0;
+    }
+}
+
+//保持在position，速度为0
+//Hold at position with zero velocity
+static inline void TrajectorySetHold(TrajectoryStream *stream, int i, double now, float position){
+    stream->seg_start_[i] = now;
+    stream->seg_duration_[i] = 0;
+    stream->seg_end_[i].time_ = now;
+    stream->seg_end_[i].position_ = position;
+    stream->seg_end_[i].velocity_ = 0;
+    stream->seg_end_[i].acceleration_ = 0;
+    stream->c0_[i] = position;
+    stream->c1_[i] = 0;
+    stream->c2_[i] = 0;
+    stream->c3_[i] = 0;
+    stream->c4_[i] = 0;
+    stream->c5_[i] = 0;
+}
+
+//在时间now计算所有关节的位置和前馈速度，结果写入position_和velocity_。
+//队列耗尽时关节保持在最后一个路点的位置
+//Evaluate position and feed-forward velocity of all motors at time now, results are written into position_ and velocity_.
+//When the queue runs out, the motor holds the position of the last waypoint
+static inline void TrajectoryEvaluate(TrajectoryStream *stream, double now){
+    const int n = stream->motor_num_;
+    for(int i = 0; i < n; i++){
+        TrajectoryPoint next;
+        while(now >= stream->seg_end_[i].time_ && TrajectoryPop(stream, i, &next)){
+            TrajectoryPoint start = stream->seg_end_[i];
+            if(stream->holding_[i]){
+                //从保持状态恢复时，从当前位置静止出发
+                //When resuming from hold, start at rest from the current position
+                start.time_ = now;
+                start.position_ = stream->position_[i];
+                start.velocity_ = 0;
+                start.acceleration_ = 0;
+            }
+            if(next.time_ <= start.time_){
+                continue;
+            }
+            TrajectoryPoint after;
+            bool has_after = TrajectoryPeek(stream, i, &after) && after.time_ > next.time_;
+            TrajectoryDeriveKnot(&start, &next, has_after ? &after : NULL);
+            TrajectorySetSegment(stream, i, &start, &next);
+            stream->holding_[i] = false;
+        }
+        if(!stream->holding_[i] && now >= stream->seg_end_[i].time_){
+            stream->holding_[i] = true;
+            stream->underrun_[i]++;
+            TrajectorySetHold(stream, i, now, stream->seg_end_[i].position_);
+        }
+    }
+
+    //对所有关节无分支地计算多项式
+    //Evaluate the polynomials of all motors without branches
+    float *position = stream->position_;
+    float *velocity = stream->velocity_;
+    for(int i = 0; i < n; i++){
+        float s = (float)(now - stream->seg_start_[i]);
+        s = s < 0 ? 0 : s;
+        s = s > stream->seg_duration_[i] ? stream->seg_duration_[i] : s;
+        float c1 = stream->c1_[i], c2 = stream->c2_[i], c3 = stream->c3_[i];
+        float c4 = stream->c4_[i], c5 = stream->c5_[i];
+        position[i] = stream->c0_[i] + s * (c1 + s * (c2 + s * (c3 + s * (c4 + s * c5))));
+        velocity[i] = c1 + s * (2.0f * c2 + s * (3.0f * c3 + s * (4.0f * c4 + s * 5.0f * c5)));
+    }
+}
+
+//用第index个关节的插值结果写入MotorCMD的控制命令
+//Write control cmd into MotorCMD with the interpolated result of the index-th motor
+static inline void TrajectorySetMotionCMD(const TrajectoryStream *stream, int index, MotorCMD *motor_cmd, uint8_t motor_id,
+                                          float torque, float kp, float kd){
+    SetMotionCMD(motor_cmd, motor_id, CONTROL_MOTOR, stream->position_[index], stream->velocity_[index], torque, kp, kd);
+}